@@ -0,0 +1,123 @@
+//  General Instrument SP0256-AL2 phonemes
+
+/* This table contains the GI phonemes and their numeric values. The text is
+the phoneme name generated by John Wasser's PHONEME program, the numeric
+values are the GI opcodes.
+
+The PHONEME software uses only a subset of the SPO256-AL2's
+opcodes. These were hand-mapped, and will likely get filled
+in and opcode use expanded later.
+*/
+
+struct _p2a {
+    char *phoneme;
+    char allophone;
+} p2a[] = {
+    {"IY", 0x13}, //  see
+    {"IH", 0x0c}, //  sit
+    {"EY", 0x14}, //  beige
+    {"EH", 0x07}, //  end, get
+    {"AE", 0x1a}, //  fat
+    {"AA", 0x18}, //  hot (father?)
+    {"AO", 0x17}, //  aught, lawn
+    {"OW", 0x35}, //  lone, beau
+    {"UH", 0x1e}, //  full, book
+    {"UW", 0x1f}, //  food, fool
+    {"ER", 0x34}, //  fir, murder
+    {"AX", 0x0f}, //  suck, about
+    {"AH", 0x0f}, //  but
+    {"AY", 0x06}, //  sky, hide
+    {"AW", 0x20}, //  out, how
+    {"OY", 0x05}, //  boy
+
+    {"h", 0x1b},  //  he
+    {"p", 0x09},  //  pow, pack
+    {"b", 0x3f},  //  business, back
+    {"t", 0x0d},  //  to, time
+    {"d", 0x21},  //  do, dime
+    {"k", 0x2a},  //  sky
+    {"g", 0x24},  //  got, goat
+    {"f", 0x28},  //  fault, food
+    {"v", 0x23},  //  vest, vault
+    {"TH", 0x1d}, //  ether, thin
+    {"DH", 0x36}, //  they, either
+    {"s", 0x37},  //  vest, Sue
+    {"z", 0x2b},  //  zoo
+    {"SH", 0x25}, //  ship, leash
+    {"ZH", 0x26}, //  azure, leisure
+    {"HH", 0x39}, //  hoe, how
+    {"m", 0x10},  //  milk, sum
+    {"n", 0x0b},  //  thin, sun
+    {"NG", 0x2c}, //  sung, anchor
+    {"l", 0x2d},  //  lake, laugh
+    {"w", 0x2e},  //  wear, wool
+    {"y", 0x19},  //  yes, young
+    {"r", 0x33},  //  rate
+    {"CH", 0x32}, //  church, char
+    {"j", 0x0a},  //  jar, dodge
+    {"WH", 0x30}, //  whig, where
+    {"P1", 0x00}, //  pause, 10ms
+    {"P2", 0x01}, //  pause, 30ms
+    {"P3", 0x02}, //  pause, 50ms
+    {"P4", 0x03}, //  pause, 100ms
+    {"P5", 0x04}, //  pause, 200ms
+
+    {"R1", 0x27}, //  reed
+    {"T1", 0x11}, //  part
+    {"EY", 0x36}, //  they
+    {"D1", 0x15}, //  could
+    {"U1", 0x16}, //  to
+    {"G3", 0x22}, //  wig
+    {"RR", 0x0e}, //  brain
+    {"K2", 0x08}, //  comb
+    {"K1", 0x29}, //  cant
+    {"XR", 0x2f}, //  pair
+    {"Y1", 0x31}, //  yes
+    {"R2", 0x34}, //  fir
+    {"N2", 0x38}, //  no
+    {"OR", 0x3a}, //  store
+    {"AR", 0x3b}, //  alarm
+    {"YR", 0x3c}, //  clear
+    {"G2", 0x3d}, //  guest
+    {"EL", 0x3e}, //  saddle
+    {"B2", 0x1c}, //  caleb
+    {"DT", 0x12}, //  they
+    {"", 0}       //  end of table
+};
+
+/* How long the SPO256-AL2 takes to say each allophone, in milliseconds,
+by opcode (from the GI data sheet).  Used to estimate playback time. */
+
+short Allo_ms[64] = {
+    10,  30,  50,  100, 200, 420, 260, 70,  //  PA1..PA5 OY AY EH
+    120, 210, 140, 140, 70,  140, 170, 70,  //  KK3 PP JH NN1 IH TT2 RR1 AX
+    180, 100, 290, 250, 280, 70,  100, 100, //  MM TT1 DH1 IY EY DD1 UW1 AO
+    100, 180, 120, 130, 80,  180, 100, 260, //  AA YY2 AE HH1 BB1 TH UH UW2
+    370, 160, 140, 190, 80,  160, 190, 120, //  AW DD2 GG3 VV GG1 SH ZH RR2
+    150, 190, 160, 210, 220, 110, 180, 360, //  FF KK2 KK1 ZZ NG LL WW XR
+    200, 130, 190, 160, 300, 240, 240, 90,  //  WH YY1 CH ER1 ER2 OW DH2 SS
+    190, 180, 330, 290, 350, 40,  190, 50   //  NN2 HH2 OR AR YR GG2 EL BB2
+};
+
+/* Fast speech (-s): quicker opcodes for the same sound, where the chip has
+two, and which opcodes are vowels, so doubled ones can be said once. */
+
+unsigned char Fast_allophones[][2] = {
+    {0x1f, 0x16}, //  UW2 260 ms -> UW1 100 ms
+    {0x21, 0x15}, //  DD2 160 -> DD1 70
+    {0x0d, 0x11}, //  TT2 140 -> TT1 100
+    {0x38, 0x0b}, //  NN2 190 -> NN1 140
+    {0x34, 0x33}, //  ER2 300 -> ER1 160
+    {0x12, 0x36}, //  DH1 290 -> DH2 240
+    {0x39, 0x1b}, //  HH2 180 -> HH1 130
+    {0x19, 0x31}, //  YY2 180 -> YY1 130
+    {0x29, 0x2a}, //  KK2 190 -> KK1 160
+    {0x22, 0x24}, //  GG3 140 -> GG1 80
+    {0x1c, 0x3f}, //  BB1 80 -> BB2 50
+    {0x0e, 0x27}, //  RR1 170 -> RR2 120
+    {0x04, 0x03}, //  PA5 200 -> PA4 100
+};
+
+unsigned char Vowel_allophones[] = {
+    0x05, 0x06, 0x07, 0x0c, 0x0f, 0x13, 0x14, 0x16, 0x17, 0x18, 0x1a,
+    0x1e, 0x1f, 0x20, 0x2f, 0x33, 0x34, 0x35, 0x3a, 0x3b, 0x3c};
@@ -1,5 +1,18 @@
 set VSCMD_START_DIR=%CD%
 call "%VS140COMNTOOLS%VsDevCmd.bat"
 
-cl tx2al.c
+cl rulegen.c
+rulegen > rules_gen.c
+cl /DGENERATED_RULES tx2al.c
+cl rulecheck.c
+rulecheck
+if errorlevel 1 exit /b 1
+cl /c /DGENERATED_RULES /DT2A_LIBRARY /Fotx2al_lib.obj tx2al.c
+lib /out:libtx2al.lib tx2al_lib.obj
+set T2A_EXPORTS=/export:sink_file /export:sink_memory /export:sink_callback /export:sink_put /export:sink_flush /export:sink_close /export:load_lexicon /export:start_fast_speech /export:start_peephole /export:use_rule_file /export:t2a_init /export:t2a_new /export:t2a_feed /export:t2a_finish /export:t2a_file /export:t2a_free /export:t2a_reload
+link /dll /out:tx2al.dll /implib:tx2al_dll.lib tx2al_lib.obj %T2A_EXPORTS%
+cl ruleopt.c
+cl lexgen.c
+cl packgen.c
+cl tracedump.c
 del *.obj
@@ -0,0 +1,301 @@
+/*
+lexgen -- compile a pronunciation lexicon for tx2al -l.
+
+Reads a text file of words and their phonemes, one per line, spelled the
+way english.c spells them:
+
+    # comment
+    TOMJ        tAAm jEY
+    WASSER      wAAsER
+
+and writes the binary lexicon described in lexicon.h: the phonemes turned
+into SPO256 opcodes and the words indexed by a minimal perfect hash, so
+tx2al maps the file and uses it as it is, with nothing to parse.  Case
+doesn't matter in the words; they may hold letters and apostrophes.
+
+    lexgen words.txt english.lex
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define FALSE (0)
+#define TRUE (!0)
+
+#include "english.c"
+#include "allophones.c"
+#include "rulepack.h"
+#include "lexicon.h"
+
+#define NUM_RULESETS ((int)(sizeof(Rules) / sizeof(Rules[0])))
+
+#include "packrules.c" //  next_phoneme(), allophone()
+
+#define MAX_WORD 126 //  longest word tx2al hands to xlate_word()
+#define MAX_OUT 255
+
+typedef struct _entry {
+    char *word;
+    unsigned char *out;
+    int word_len, out_len;
+    unsigned int bucket;
+} Entry;
+
+static Entry *Entries;
+static int Count, Allocated;
+static int Errors;
+
+static void *need(void *p)
+{
+    if (p == 0) {
+        fputs("Error: Out of memory.\n", stderr);
+        exit(3);
+    }
+    return p;
+}
+
+//  Phonemes to opcodes, split and looked up as the rule outputs are.
+static int opcodes(char *s, unsigned char *out, char *name, int line)
+{
+    char phoneme[3], *p;
+    int n = 0, a;
+
+    for (p = s; *p; p++) { //  next_phoneme() skips blanks, not tabs
+        if (isspace((unsigned char)*p))
+            *p = ' ';
+    }
+    while (next_phoneme(&s, phoneme)) {
+        a = allophone(phoneme);
+        if (a < 0) {
+            fprintf(stderr, "%s:%d: phoneme \"%s\" not in allophone table\n",
+                    name, line, phoneme);
+            Errors++;
+            continue;
+        }
+        if (n == MAX_OUT) {
+            fprintf(stderr, "%s:%d: too many phonemes\n", name, line);
+            Errors++;
+            break;
+        }
+        out[n++] = (unsigned char)a;
+    }
+    return n;
+}
+
+static void read_words(char *name)
+{
+    FILE *file;
+    char line[1024], *p, *word;
+    unsigned char out[MAX_OUT];
+    Entry *e;
+    int n, len;
+
+    file = fopen(name, "r");
+    if (file == 0) {
+        fprintf(stderr, "Error: Cannot open %s.\n", name);
+        exit(1);
+    }
+    for (n = 1; fgets(line, sizeof(line), file); n++) {
+        for (p = line; isspace((unsigned char)*p); p++)
+            ;
+        if (*p == '\0' || *p == '#')
+            continue;
+        for (word = p; *p && !isspace((unsigned char)*p); p++) {
+            *p = (char)toupper((unsigned char)*p);
+            if (!isupper((unsigned char)*p) && *p != '\'') {
+                fprintf(stderr, "%s:%d: bad character in word\n", name, n);
+                Errors++;
+                break;
+            }
+        }
+        len = (int)(p - word);
+        if (len > MAX_WORD) {
+            fprintf(stderr, "%s:%d: word too long\n", name, n);
+            Errors++;
+            continue;
+        }
+        if (*p)
+            *p++ = '\0';
+
+        if (Count == Allocated) {
+            Allocated = Allocated ? 2 * Allocated : 1024;
+            Entries = need(realloc(Entries, Allocated * sizeof(Entry)));
+        }
+        e = &Entries[Count++];
+        e->word_len = len;
+        e->word = need(malloc(len + 1));
+        memcpy(e->word, word, len + 1);
+        e->out_len = opcodes(p, out, name, n);
+        e->out = need(malloc(e->out_len + 1));
+        memcpy(e->out, out, e->out_len);
+    }
+    fclose(file);
+}
+
+static int by_word(const void *a, const void *b)
+{
+    const Entry *x = a, *y = b;
+
+    return strcmp(x->word, y->word);
+}
+
+static unsigned int Buckets;
+static int *Bucket_size;
+
+static int by_bucket_size(const void *a, const void *b)
+{
+    int x = Bucket_size[*(const unsigned int *)a];
+    int y = Bucket_size[*(const unsigned int *)b];
+
+    if (x != y)
+        return y - x;
+    return *(const unsigned int *)a < *(const unsigned int *)b ? -1 : 1;
+}
+
+/* Hash and displace: take the buckets biggest first and find each a seed
+that puts all of its words in slots nobody has yet. */
+static void place(unsigned int *disp, int *slot_of)
+{
+    unsigned int *order, b, seed, s;
+    int *first, *next, *taken, i, j, k, *tried;
+
+    Bucket_size = need(calloc(Buckets, sizeof(int)));
+    first = need(malloc(Buckets * sizeof(int)));
+    next = need(malloc(Count * sizeof(int)));
+    order = need(malloc(Buckets * sizeof(unsigned int)));
+    taken = need(calloc(Count, sizeof(int)));
+    tried = need(malloc(Count * sizeof(int)));
+
+    for (b = 0; b < Buckets; b++) {
+        first[b] = -1;
+        order[b] = b;
+    }
+    for (i = 0; i < Count; i++) {
+        b = Entries[i].bucket;
+        next[i] = first[b];
+        first[b] = i;
+        Bucket_size[b]++;
+    }
+    qsort(order, Buckets, sizeof(unsigned int), by_bucket_size);
+
+    for (j = 0; j < (int)Buckets && Bucket_size[order[j]]; j++) {
+        b = order[j];
+        for (seed = 1;; seed++) {
+            if (seed == 0) {
+                fputs("Error: No perfect hash found.\n", stderr);
+                exit(1);
+            }
+            k = 0;
+            for (i = first[b]; i >= 0; i = next[i]) {
+                s = lex_hash(seed, Entries[i].word, Entries[i].word_len) % Count;
+                if (taken[s])
+                    break;
+                taken[s] = TRUE;
+                tried[k++] = s;
+            }
+            if (i < 0)
+                break; //  all of them fit
+            while (k)
+                taken[tried[--k]] = FALSE;
+        }
+        disp[b] = seed;
+        for (i = first[b]; i >= 0; i = next[i])
+            slot_of[lex_hash(seed, Entries[i].word, Entries[i].word_len) % Count] = i;
+    }
+
+    free(Bucket_size);
+    free(first);
+    free(next);
+    free(order);
+    free(taken);
+    free(tried);
+}
+
+static void write_lexicon(char *name)
+{
+    FILE *file;
+    Lexhead head;
+    Lexslot slot;
+    unsigned int *disp, text;
+    int *slot_of, i;
+    Entry *e;
+
+    disp = need(calloc(Buckets, sizeof(unsigned int)));
+    slot_of = need(malloc((Count ? Count : 1) * sizeof(int)));
+    if (Count)
+        place(disp, slot_of);
+
+    head.magic = LEX_MAGIC;
+    head.version = LEX_VERSION;
+    head.count = Count;
+    head.buckets = Buckets;
+    head.disp = sizeof(Lexhead);
+    head.slot = head.disp + Buckets * sizeof(unsigned int);
+    head.text = head.slot + Count * sizeof(Lexslot);
+    head.size = head.text;
+    for (i = 0; i < Count; i++)
+        head.size += Entries[i].word_len + Entries[i].out_len;
+
+    file = fopen(name, "wb");
+    if (file == 0) {
+        fprintf(stderr, "Error: Cannot create %s.\n", name);
+        exit(2);
+    }
+    fwrite(&head, sizeof(head), 1, file);
+    fwrite(disp, sizeof(unsigned int), Buckets, file);
+    for (text = head.text, i = 0; i < Count; i++) {
+        e = &Entries[slot_of[i]];
+        slot.word = text;
+        slot.word_len = (unsigned short)e->word_len;
+        slot.out = text + e->word_len;
+        slot.out_len = (unsigned short)e->out_len;
+        text += e->word_len + e->out_len;
+        fwrite(&slot, sizeof(slot), 1, file);
+    }
+    for (i = 0; i < Count; i++) {
+        e = &Entries[slot_of[i]];
+        fwrite(e->word, 1, e->word_len, file);
+        fwrite(e->out, 1, e->out_len, file);
+    }
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Error: Cannot write %s.\n", name);
+        exit(2);
+    }
+    free(disp);
+    free(slot_of);
+}
+
+int main(argc, argv) int argc;
+char *argv[];
+{
+    int i;
+
+    if (argc != 3) {
+        fprintf(stderr, "Try:\n    lexgen words.txt english.lex\n");
+        exit(0);
+    }
+    read_words(argv[1]);
+
+    //  Duplicates would need two slots for one word
+    qsort(Entries, Count, sizeof(Entry), by_word);
+    for (i = 1; i < Count; i++) {
+        if (strcmp(Entries[i - 1].word, Entries[i].word) == 0) {
+            fprintf(stderr, "%s: %s is in there twice\n", argv[1], Entries[i].word);
+            Errors++;
+        }
+    }
+    if (Errors) {
+        fprintf(stderr, "%d errors, no lexicon written\n", Errors);
+        exit(1);
+    }
+
+    Buckets = Count / 4 + 1; //  about four words a bucket
+    for (i = 0; i < Count; i++)
+        Entries[i].bucket = lex_hash(0, Entries[i].word, Entries[i].word_len) % Buckets;
+    write_lexicon(argv[2]);
+
+    fprintf(stderr, "%d words, %u buckets\n", Count, Buckets);
+    return 0;
+}
@@ -0,0 +1,44 @@
+/* Compiled pronunciation lexicon, shared by lexgen (which writes it) and
+tx2al (which maps it and reads it in place).
+
+    Lexhead                 at offset 0
+    unsigned int disp[]     one hash seed per bucket, at disp
+    Lexslot slot[]          one per word, at slot
+    char text[]             words and allophones, at text
+
+A word is found in one probe: its bucket is lex_hash(0, word) % buckets,
+and its slot is lex_hash(disp[bucket], word) % count.  lexgen picks each
+bucket's seed so every word gets a slot of its own (a minimal perfect
+hash); the word is still compared, since other text lands on some slot
+too.  Words are stored uppercase without the blanks around them, values
+are SPO256 opcodes without any bias.  Everything is in the byte order of
+the machine that built it; the magic number catches a mismatch. */
+
+#define LEX_MAGIC 0x5832414cU //  "LA2X" little endian
+#define LEX_VERSION 1
+
+typedef struct _lexhead {
+    unsigned int magic, version;
+    unsigned int count;   //  words (and slots)
+    unsigned int buckets; //  entries in disp[]
+    unsigned int disp, slot, text, size; //  offsets and file length
+} Lexhead;
+
+typedef struct _lexslot {
+    unsigned int word, out;            //  offsets into the file
+    unsigned short word_len, out_len;
+} Lexslot;
+
+static unsigned int lex_hash(unsigned int seed, const char *s, int len)
+{
+    unsigned int h = 2166136261U ^ (seed * 0x9e3779b9U); //  FNV-1a
+
+    while (len--)
+        h = (h ^ (unsigned char)*s++) * 16777619U;
+    h ^= h >> 16; //  mix so nearby seeds differ everywhere
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return h;
+}
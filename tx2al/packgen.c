@@ -0,0 +1,79 @@
+/*
+packgen -- compile rule tables into a rule pack for tx2al -u.
+
+Takes Rules[] tables written the way english.c writes them (punct_rules,
+A_rules .. Z_rules) and writes the pack described in rulepack.h: the
+rules packed and their contexts compiled exactly as tx2al does it for
+english.c at startup, phonemes turned into SPO256 opcodes.  tx2al maps
+the file and uses it in place, so another rule set, or a tuned copy of
+english.c, needs no rebuild of tx2al.  The pack is written under another
+name and renamed into place, so a tx2al watching it never maps half of
+one.  The tables are compiled in:
+
+    cl packgen.c                            english.c
+    cl /DRULES=\"dialect.c\" packgen.c      some other set
+    packgen english.pack
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define FALSE (0)
+#define TRUE (!0)
+
+#ifndef RULES
+#define RULES "english.c"
+#endif
+
+#include RULES
+#include "allophones.c"
+#include "rulepack.h"
+
+#define NUM_RULESETS ((int)(sizeof(Rules) / sizeof(Rules[0])))
+
+#include "packrules.c"
+
+int main(argc, argv) int argc;
+char *argv[];
+{
+    FILE *file;
+    Packhead *h;
+    unsigned long size;
+    char *temp;
+
+    if (argc != 2) {
+        fprintf(stderr, "Try:\n    packgen english.pack\n");
+        exit(0);
+    }
+    h = pack_rules(&size);
+    report_unknown_phonemes();
+
+    temp = malloc(strlen(argv[1]) + 5);
+    if (temp == 0) {
+        fputs("Error: Out of memory.\n", stderr);
+        exit(3);
+    }
+    sprintf(temp, "%s.new", argv[1]);
+    file = fopen(temp, "wb");
+    if (file == 0) {
+        fprintf(stderr, "Error: Cannot create %s.\n", temp);
+        exit(2);
+    }
+    fwrite(h, 1, size, file);
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Error: Cannot write %s.\n", temp);
+        exit(2);
+    }
+    if (rename(temp, argv[1]) != 0) { //  Windows won't rename over a file
+        remove(argv[1]);
+        if (rename(temp, argv[1]) != 0) {
+            fprintf(stderr, "Error: Cannot rename %s to %s.\n", temp, argv[1]);
+            exit(2);
+        }
+    }
+
+    fprintf(stderr, "%u rules, %lu bytes\n", h->count, size);
+    return 0;
+}
@@ -0,0 +1,372 @@
+/*
+**    Packed rules.
+**
+**    pack_rules() turns the Rules[] tables into the rule pack described in
+**    rulepack.h, structure of arrays style: the lengths and text offsets of
+**    each rule's four strings sit in parallel arrays indexed by packed rule
+**    number, and the strings themselves are laid out back to back (NUL
+**    terminated) in text[].  The left context is stored reversed so it can
+**    be matched front to back, the output as opcodes.  Rules of one table
+**    are numbered consecutively from first[type], so a scan over a table's
+**    candidates stays within a few cache lines.
+**
+**    tx2al packs english.c this way at startup; packgen does the same for
+**    any tables written like it and saves the result, which tx2al -u maps
+**    as it is.  Both include this file after the rule tables, p2a and
+**    rulepack.h, as do tracedump (for the phoneme names), rulegen (for
+**    rules_hash()) and lexgen (to spell its phonemes as the rules do).
+*/
+
+//  Split the next phoneme off *s; FALSE when the string is exhausted.
+static int next_phoneme(char **s, char *phoneme)
+{
+    while (**s == ' ')
+        ++*s;
+    if (**s == '\0')
+        return FALSE;
+    phoneme[0] = *(*s)++;
+    phoneme[1] = '\0';
+    if (isupper(phoneme[0]) && **s != '\0') { //  upper case phonemes are two chars long,
+        phoneme[1] = *(*s)++;                 //  lower case ones one
+        phoneme[2] = '\0';
+    }
+    return TRUE;
+}
+
+//  GI opcode for a phoneme name, -1 if it isn't in the table
+static int allophone(char *phoneme)
+{
+    struct _p2a *t;
+
+    for (t = p2a; *t->phoneme; ++t) { //  search the table for it
+        if (strcmp(t->phoneme, phoneme) == 0)
+            return t->allophone;
+    }
+    return -1;
+}
+
+static unsigned long Unknown_phonemes; //  tx2al reports them with --stats
+
+/* The distinct phonemes missing from p2a, each with the first string it
+turned up in, for report_unknown_phonemes(). */
+#define MAX_UNKNOWN 32
+static char Unknown_name[MAX_UNKNOWN][3];
+static char *Unknown_in[MAX_UNKNOWN];
+static int Unknown_count;
+
+static void note_unknown(char *phoneme, char *s)
+{
+    int i;
+
+    Unknown_phonemes++;
+    for (i = 0; i < Unknown_count; i++) {
+        if (strcmp(Unknown_name[i], phoneme) == 0)
+            return;
+    }
+    if (Unknown_count < MAX_UNKNOWN) {
+        strcpy(Unknown_name[Unknown_count], phoneme);
+        Unknown_in[Unknown_count++] = s;
+    }
+}
+
+/* A phoneme string as opcodes, no bias.  A phoneme missing from p2a is
+noted for report_unknown_phonemes() and left out.  Returns the number
+stored at op, never more than strlen(s). */
+static int phoneme_codes(char *s, unsigned char *op)
+{
+    char *q, phoneme[3];
+    int n, a;
+
+    q = s;
+    n = 0;
+    while (next_phoneme(&s, phoneme)) {
+        a = allophone(phoneme);
+        if (a < 0)
+            note_unknown(phoneme, q);
+        else
+            op[n++] = (unsigned char)a;
+    }
+    return n;
+}
+
+//  Warn of each phoneme phoneme_codes() couldn't find, once, as tables load.
+void report_unknown_phonemes()
+{
+    int i;
+
+    for (i = 0; i < Unknown_count; i++)
+        fprintf(stderr, "Phoneme \"%s\" in string \"%s\" not in allophone table!\n",
+                Unknown_name[i], Unknown_in[i]);
+}
+
+static unsigned char *Ctx_code; //  context programs while packing
+static int Ctx_used, Ctx_size;
+
+static void ctx_emit(int byte)
+{
+    if (Ctx_used == Ctx_size) {
+        Ctx_size = Ctx_size ? Ctx_size * 2 : 4096;
+        Ctx_code = realloc(Ctx_code, Ctx_size);
+        if (Ctx_code == 0) {
+            fputs("Error: Out of memory compiling rules.\n", stderr);
+            exit(3);
+        }
+    }
+    Ctx_code[Ctx_used++] = (unsigned char)byte;
+}
+
+static int is_ctx_text(char c)
+{
+    return isalpha(c) || c == '\'' || c == ' ';
+}
+
+/* Compile a context pattern, given in the order it is matched: left
+patterns arrive already reversed.  Returns the Ctx_code offset, or 0 for
+an empty pattern. */
+static unsigned short compile_context(char *pat, int left)
+{
+    int start, n, i;
+
+    if (*pat == '\0')
+        return 0;
+
+    start = Ctx_used;
+    while (*pat != '\0') {
+        if (is_ctx_text(*pat)) {
+            for (n = 1; n < CTX_RUN && is_ctx_text(pat[n]); n++)
+                ;
+            ctx_emit(CTX_LIT);
+            ctx_emit(n);
+            for (i = 0; i < n; i++) //  literal runs go in text order
+                ctx_emit(left ? pat[n - 1 - i] : pat[i]);
+            pat += n;
+            continue;
+        }
+        switch (*pat) {
+            case '#': ctx_emit(CTX_VOWELS); break;
+            case ':': ctx_emit(CTX_CONS0); break;
+            case '^': ctx_emit(CTX_CONS1); break;
+            case '.': ctx_emit(CTX_VOICED); break;
+            case '+': ctx_emit(CTX_FRONT); break;
+            case '%':
+                if (left) { //  suffixes only follow
+                    fputs("Bad char in left rule: '%'\n", stderr);
+                    ctx_emit(CTX_FAIL);
+                } else {
+                    ctx_emit(CTX_SUFFIX);
+                }
+                break;
+            default:
+                fprintf(stderr, "Bad char in %s rule: '%c'\n",
+                        left ? "left" : "right", *pat);
+                ctx_emit(CTX_FAIL);
+                break;
+        }
+        pat++;
+    }
+    ctx_emit(CTX_END);
+
+    if (Ctx_used > 0xffff) {
+        fputs("Error: Rule tables too large to pack.\n", stderr);
+        exit(3);
+    }
+    return (unsigned short)start;
+}
+
+static unsigned short pack_string(char *text, char *s, int *used, int reversed)
+{
+    int len, i, at;
+
+    at = *used;
+    len = (int)strlen(s);
+    for (i = 0; i < len; i++)
+        text[at + i] = reversed ? s[len - 1 - i] : s[i];
+    text[at + len] = '\0';
+    *used += len + 1;
+    return (unsigned short)at;
+}
+
+//  What the first op of a context program needs of the adjacent character.
+static void signature(int code, int left, unsigned char *cls, unsigned char *byte)
+{
+    unsigned char *op, c;
+
+    *cls = 0;
+    *byte = 0;
+    if (code == 0)
+        return;
+
+    op = &Ctx_code[code];
+    switch (op[0]) {
+        case CTX_LIT: //  nearest byte of the run
+            c = left ? op[1 + op[1]] : op[2];
+            if (c == ' ')
+                *cls = CC_BLANK;
+            else
+                *byte = c;
+            break;
+        case CTX_VOWELS: *cls = CC_VOWEL; break;
+        case CTX_CONS1: *cls = CC_CONSONANT; break;
+        case CTX_VOICED: *cls = CC_VOICED; break;
+        case CTX_FRONT: *cls = CC_FRONT; break;
+    }
+}
+
+/* FNV-1a hash of every string of every rule, NULs included, tables in
+order.  rulegen writes it into rules_gen.c and tx2al compares it with its
+own Rules[], so generated matchers made from other tables go unused. */
+unsigned long rules_hash()
+{
+    Rule *rule;
+    unsigned long h;
+    char *s;
+    int type, i;
+
+    h = 2166136261UL;
+    for (type = 0; type < NUM_RULESETS; type++) {
+        for (rule = Rules[type]; (*rule)[1] != 0; rule++) {
+            for (i = 0; i < 4; i++) {
+                s = (*rule)[i];
+                do
+                    h = ((h ^ (unsigned char)*s) * 16777619UL) & 0xffffffffUL;
+                while (*s++ != '\0');
+            }
+        }
+        h = ((h ^ 0xff) * 16777619UL) & 0xffffffffUL; //  end of table
+    }
+    return h;
+}
+
+/* Pack Rules[] into a newly allocated rule pack.  Returns it, its length
+in *size. */
+void *pack_rules(unsigned long *size)
+{
+    Packhead *h;
+    Packphoneme *ph;
+    Rule *rule;
+    struct _p2a *t;
+    unsigned short *match, *left, *right, *out, *lcode, *rcode;
+    unsigned char *image, *mlen, *llen, *rlen, *olen;
+    unsigned char *lclass, *rclass, *lbyte, *rbyte;
+    char *text;
+    int type, id, count, used, nphonemes, i;
+    size_t chars;
+
+    if (NUM_RULESETS != PACK_TABLES) {
+        fprintf(stderr, "Error: %d rule tables, a pack holds %d.\n",
+                NUM_RULESETS, PACK_TABLES);
+        exit(1);
+    }
+
+    //  Size everything
+    chars = 0;
+    count = 0;
+    for (type = 0; type < NUM_RULESETS; type++) {
+        for (rule = Rules[type]; (*rule)[1] != 0; rule++, count++) {
+            for (i = 0; i < 4; i++) {
+                if (strlen((*rule)[i]) > 255) {
+                    fprintf(stderr, "Error: Rule string too long: \"%s\"\n",
+                            (*rule)[i]);
+                    exit(3);
+                }
+                chars += strlen((*rule)[i]) + 1;
+            }
+        }
+    }
+    if (chars > 0xffff) {
+        fputs("Error: Rule tables too large to pack.\n", stderr);
+        exit(3);
+    }
+    for (nphonemes = 0, t = p2a; *t->phoneme; ++t) {
+        if (allophone(t->phoneme) == t->allophone) //  not hidden by an earlier one
+            nphonemes++;
+    }
+
+    /* Everything but the context programs has a known size; the programs
+    are compiled into Ctx_code as the rules are filled in and copied to the
+    end once they are all done. */
+    h = calloc(1, sizeof(Packhead) + count * (6 * sizeof(unsigned short) + 8) + chars);
+    if (h == 0) {
+        fputs("Error: Out of memory packing rules.\n", stderr);
+        exit(3);
+    }
+    h->magic = PACK_MAGIC;
+    h->version = PACK_VERSION;
+    h->count = count;
+    h->shorts = sizeof(Packhead);
+    h->bytes = h->shorts + count * 6 * sizeof(unsigned short);
+    h->text = h->bytes + count * 8;
+    h->code = h->text + (unsigned int)chars;
+
+    image = (unsigned char *)h;
+    match = (unsigned short *)(image + h->shorts);
+    left = match + count;
+    right = left + count;
+    out = right + count;
+    lcode = out + count;
+    rcode = lcode + count;
+    mlen = image + h->bytes;
+    llen = mlen + count;
+    rlen = llen + count;
+    olen = rlen + count;
+    lclass = olen + count;
+    rclass = lclass + count;
+    lbyte = rclass + count;
+    rbyte = lbyte + count;
+    text = (char *)(image + h->text);
+
+    //  Fill it in, table by table
+    Ctx_used = 0;
+    ctx_emit(CTX_END); //  offset 0 is "no context"
+    used = 0;
+    id = 0;
+    for (type = 0; type < NUM_RULESETS; type++) {
+        h->first[type] = id;
+        for (rule = Rules[type]; (*rule)[1] != 0; rule++, id++) {
+            mlen[id] = (unsigned char)strlen((*rule)[1]);
+            llen[id] = (unsigned char)strlen((*rule)[0]);
+            rlen[id] = (unsigned char)strlen((*rule)[2]);
+            match[id] = pack_string(text, (*rule)[1], &used, FALSE);
+            left[id] = pack_string(text, (*rule)[0], &used, TRUE);
+            right[id] = pack_string(text, (*rule)[2], &used, FALSE);
+            out[id] = (unsigned short)used; //  opcodes, not text
+            olen[id] = (unsigned char)phoneme_codes(
+                (*rule)[3], (unsigned char *)&text[used]);
+            used += (int)strlen((*rule)[3]) + 1;
+
+            lcode[id] = compile_context(&text[left[id]], TRUE);
+            rcode[id] = compile_context(&text[right[id]], FALSE);
+            signature(lcode[id], TRUE, &lclass[id], &lbyte[id]);
+            signature(rcode[id], FALSE, &rclass[id], &rbyte[id]);
+        }
+    }
+    h->first[type] = id;
+
+    //  Then the context programs and the allophone table
+    h->phonemes = h->code + Ctx_used;
+    h->nphonemes = nphonemes;
+    h->size = h->phonemes + nphonemes * sizeof(Packphoneme);
+    h = realloc(h, h->size);
+    if (h == 0) {
+        fputs("Error: Out of memory packing rules.\n", stderr);
+        exit(3);
+    }
+    image = (unsigned char *)h;
+    memcpy(image + h->code, Ctx_code, Ctx_used);
+    ph = (Packphoneme *)(image + h->phonemes);
+    for (t = p2a; *t->phoneme; ++t) {
+        if (allophone(t->phoneme) != t->allophone)
+            continue;
+        ph->name[0] = t->phoneme[0];
+        ph->name[1] = t->phoneme[1];
+        ph->op = (unsigned char)t->allophone;
+        ph->spare = 0;
+        ph++;
+    }
+
+    free(Ctx_code); //  ready for the next set of tables
+    Ctx_code = 0;
+    Ctx_used = Ctx_size = 0;
+    *size = h->size;
+    return h;
+}
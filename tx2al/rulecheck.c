@@ -0,0 +1,106 @@
+/*
+rulecheck -- check the generated rule matchers against the interpreter.
+
+Built from tx2al.c itself, with GENERATED_RULES and rules_gen.c as tx2al
+is, it says every word twice, once through the gen_rules_ functions and
+once through find_rule()'s interpreter, and reports any word on which
+the two differ.  The words are each rule's match string on its own and
+with every letter before and after it, then the words of any files
+named.  Exits 1 if a word differs or rules_gen.c doesn't match english.c.
+
+    rulegen > rules_gen.c
+    cc -O2 -o rulecheck rulecheck.c -lm
+    rulecheck [file ...]
+*/
+
+#define T2A_LIBRARY
+#ifndef GENERATED_RULES
+#define GENERATED_RULES
+#endif
+#include "tx2al.c"
+
+static int Differ = 0;
+static unsigned long Words = 0;
+
+//  The word's allophones, once each way, and complain if they differ.
+static void check_word(t2a_context *t, Sink *out, char *word)
+{
+    static unsigned char gen[4096];
+    unsigned long gen_len;
+
+    Words++;
+    out->len = 0;
+    Use_generated = TRUE;
+    t2a_feed(t, word, strlen(word));
+    t2a_finish(t);
+    gen_len = out->len < sizeof(gen) ? out->len : sizeof(gen);
+    memcpy(gen, out->buf, gen_len);
+    out->len = 0;
+    Use_generated = FALSE;
+    t2a_feed(t, word, strlen(word));
+    t2a_finish(t);
+    if (out->len != gen_len || memcmp(out->buf, gen, gen_len) != 0) {
+        if (Differ++ < 20)
+            fprintf(stderr, "Differs: \"%s\"\n", word);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Rule *rule;
+    Sink out;
+    t2a_context *t;
+    char word[256], *match;
+    FILE *f;
+    int type, c, n, i;
+
+    Cache_entries = 0; //  both ways must really be run
+    t2a_init();
+    if (!Use_generated) //  check_generated_rules() said why
+        return 1;
+    sink_memory(&out, 0, 0);
+    t = t2a_new(&out);
+
+    for (type = 0; type < NUM_RULESETS; type++) {
+        for (rule = Rules[type]; (*rule)[1] != 0; rule++) {
+            match = (*rule)[1];
+            if (strlen(match) + 3 > sizeof(word))
+                continue;
+            check_word(t, &out, match);
+            for (c = 'A'; c <= 'Z'; c++) {
+                sprintf(word, "%c%s", c, match);
+                check_word(t, &out, word);
+                sprintf(word, "%s%c", match, c);
+                check_word(t, &out, word);
+            }
+        }
+    }
+    for (i = 1; i < argc; i++) { //  and words of the caller's
+        f = fopen(argv[i], "r");
+        if (f == 0) {
+            fprintf(stderr, "Error: Can't read %s\n", argv[i]);
+            return 1;
+        }
+        n = 0;
+        while ((c = getc(f)) != EOF) {
+            if (isalpha(c) || c == '\'') {
+                if (n < (int)sizeof(word) - 1)
+                    word[n++] = (char)c;
+            } else if (n > 0) {
+                word[n] = '\0';
+                check_word(t, &out, word);
+                n = 0;
+            }
+        }
+        if (n > 0) {
+            word[n] = '\0';
+            check_word(t, &out, word);
+        }
+        fclose(f);
+    }
+
+    t2a_free(t);
+    sink_close(&out);
+    fprintf(stderr, "rulecheck: %lu words, %d differ\n", Words, Differ);
+    return Differ ? 1 : 0;
+}
@@ -0,0 +1,225 @@
+/*
+rulegen -- compile the english.c rule tables into C.
+
+Reads the same Rules[] tables tx2al interprets (punct_rules, A_rules ..
+Z_rules) and writes one matcher function per table.  Each rule becomes a
+block of straight-line character compares for the match string and the
+left and right context patterns, tried in table order, so the first rule
+to pass is the one find_rule() would have chosen, and speaks its output
+through outrule(), which has it as opcodes already.  Build tx2al with
+GENERATED_RULES defined and the output of this program in rules_gen.c to
+use them; the interpreter in tx2al.c stays as the fallback (-R) and is
+the reference the generated code is checked against.
+
+    rulegen > rules_gen.c
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define FALSE (0)
+#define TRUE (!0)
+
+#include "english.c"
+#include "allophones.c"
+#include "rulepack.h"
+
+#define NUM_RULESETS ((int)(sizeof(Rules) / sizeof(Rules[0])))
+
+#include "packrules.c" //  rules_hash()
+
+static int Bad_rules = 0;
+
+static char *cchar(int c)
+{
+    static char buff[8];
+
+    if (c == '\'' || c == '\\')
+        sprintf(buff, "'\\%c'", c);
+    else
+        sprintf(buff, "'%c'", c);
+    return buff;
+}
+
+static int is_literal(int c)
+{
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '\'' ||
+           c == ' ';
+}
+
+static void cstring(char *s)
+{
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            putchar('\\');
+        putchar(*s);
+    }
+    putchar('"');
+}
+
+//  Left context, matched right to left starting at t = word + index - 1
+static void gen_left(char *pattern, int label)
+{
+    char *pat;
+
+    for (pat = pattern + strlen(pattern); pat-- != pattern;) {
+        if (is_literal(*pat)) {
+            printf("        if (*t != %s) goto r%d;\n", cchar(*pat), label);
+            printf("        t--;\n");
+            continue;
+        }
+        switch (*pat) {
+            case '#':
+                printf("        if (!isvowel(*t)) goto r%d;\n", label);
+                printf("        for (t--; isvowel(*t); t--) ;\n");
+                break;
+            case ':':
+                printf("        while (isconsonant(*t)) t--;\n");
+                break;
+            case '^':
+                printf("        if (!isconsonant(*t)) goto r%d;\n", label);
+                printf("        t--;\n");
+                break;
+            case '.':
+                printf("        if (!GEN_VOICED(*t)) goto r%d;\n", label);
+                printf("        t--;\n");
+                break;
+            case '+':
+                printf("        if (!GEN_FRONT(*t)) goto r%d;\n", label);
+                printf("        t--;\n");
+                break;
+            default:
+                fprintf(stderr, "Bad char in left rule: '%c'\n", *pat);
+                printf("        goto r%d; /* bad char '%c' */\n", label, *pat);
+                Bad_rules++;
+                return;
+        }
+    }
+}
+
+//  Right context, matched left to right starting at t = end of match
+static void gen_right(char *pattern, int label)
+{
+    char *pat;
+
+    for (pat = pattern; *pat != '\0'; pat++) {
+        if (is_literal(*pat)) {
+            printf("        if (*t != %s) goto r%d;\n", cchar(*pat), label);
+            printf("        t++;\n");
+            continue;
+        }
+        switch (*pat) {
+            case '#':
+                printf("        if (!isvowel(*t)) goto r%d;\n", label);
+                printf("        for (t++; isvowel(*t); t++) ;\n");
+                break;
+            case ':':
+                printf("        while (isconsonant(*t)) t++;\n");
+                break;
+            case '^':
+                printf("        if (!isconsonant(*t)) goto r%d;\n", label);
+                printf("        t++;\n");
+                break;
+            case '.':
+                printf("        if (!GEN_VOICED(*t)) goto r%d;\n", label);
+                printf("        t++;\n");
+                break;
+            case '+':
+                printf("        if (!GEN_FRONT(*t)) goto r%d;\n", label);
+                printf("        t++;\n");
+                break;
+            case '%':
+                printf("        if (t[0] == 'E') {\n");
+                printf("            if (t[1] == 'L' && t[2] == 'Y') t += 3;\n");
+                printf("            else if (t[1] == 'R' || t[1] == 'S' || "
+                       "t[1] == 'D') t += 2;\n");
+                printf("            else t++;\n");
+                printf("        } else if (t[0] == 'I' && t[1] == 'N' && "
+                       "t[2] == 'G') t += 3;\n");
+                printf("        else goto r%d;\n", label);
+                break;
+            default:
+                fprintf(stderr, "Bad char in right rule:'%c'\n", *pat);
+                printf("        goto r%d; /* bad char '%c' */\n", label, *pat);
+                Bad_rules++;
+                return;
+        }
+    }
+}
+
+static void gen_table(int type, int first)
+{
+    Rule *rule;
+    char *match;
+    int label, len, i;
+
+    printf("static int gen_rules_%d(char *word, int index)\n{\n", type);
+    printf("    char *w = word + index;\n");
+    for (rule = Rules[type]; (*rule)[1] != 0; rule++) {
+        if (*(*rule)[0] != '\0' || *(*rule)[2] != '\0') {
+            printf("    char *t;\n");
+            break;
+        }
+    }
+    printf("\n");
+
+    for (label = 0, rule = Rules[type]; (*rule)[1] != 0; rule++, label++) {
+        match = (*rule)[1];
+        len = (int)strlen(match);
+
+        printf("    /* {");
+        for (i = 0; i < 4; i++) {
+            cstring((*rule)[i]);
+            printf(i < 3 ? ", " : "} */\n");
+        }
+        printf("    {\n");
+        for (i = 0; i < len; i++)
+            printf("        if (w[%d] != %s) goto r%d;\n", i, cchar(match[i]), label);
+        if (*(*rule)[0] != '\0') {
+            printf("        t = w - 1;\n");
+            gen_left((*rule)[0], label);
+        }
+        if (*(*rule)[2] != '\0') {
+            printf("        t = w + %d;\n", len);
+            gen_right((*rule)[2], label);
+        }
+        printf("        outrule(%d);\n", first + label);
+        printf("        return index + %d;\n", len);
+        printf("    }\n");
+        printf("r%d:\n", label);
+    }
+    printf("    return 0; /* no rule */\n}\n\n");
+}
+
+int main()
+{
+    Rule *rule;
+    int type, first;
+
+    printf("/* Generated by rulegen from english.c -- do not edit. */\n\n");
+    printf("#define GEN_VOICED(c) ((c) == 'B' || (c) == 'D' || (c) == 'V' || "
+           "(c) == 'G' || \\\n"
+           "    (c) == 'J' || (c) == 'L' || (c) == 'M' || (c) == 'N' || \\\n"
+           "    (c) == 'R' || (c) == 'W' || (c) == 'Z')\n");
+    printf("#define GEN_FRONT(c) ((c) == 'E' || (c) == 'I' || (c) == 'Y')\n\n");
+
+    //  Rules are numbered as pack_rules() numbers them
+    for (first = 0, type = 0; type < NUM_RULESETS; type++) {
+        gen_table(type, first);
+        for (rule = Rules[type]; (*rule)[1] != 0; rule++)
+            first++;
+    }
+
+    printf("static int (*Gen_rules[])(char *, int) = {\n");
+    for (type = 0; type < NUM_RULESETS; type++)
+        printf("    gen_rules_%d,\n", type);
+    printf("};\n\n");
+
+    //  So tx2al can refuse a rules_gen.c made from other tables
+    printf("static unsigned long Gen_hash = 0x%08lxUL;\n", rules_hash());
+
+    return Bad_rules ? 1 : 0;
+}
@@ -0,0 +1,325 @@
+/*
+ruleopt -- reorder the english.c rule tables hottest rule first.
+
+find_rule() takes the first rule in a table whose match text and contexts
+fit, so the order of the tables decides how many rules get tried for each
+letter.  ruleopt reads rule profiles written by "tx2al -p profile" over
+real text, works out from the match strings and context patterns which
+rules may change places without changing which rule fires first, and
+writes a new english.c in which each table is ordered by hit count as far
+as that allows.
+
+Two rules of a table may be swapped when they can never both apply at the
+same position: somewhere at a fixed distance from the start of the match,
+the characters one rule accepts and those the other accepts don't meet.
+Context symbols of fixed width (text, ^, . and +) and the first character
+of # and % are taken into account; : and whatever follows a # or % are not.
+A rule is dead when an earlier rule of fixed width accepts everything it
+accepts, so the earlier one always fires first; dead rules are reported
+and left out.  Anything that can't be proved keeps its original order.
+
+    tx2al -p prof1.txt -i corpus1.txt -o nul
+    ruleopt prof1.txt [prof2.txt ...] > english_opt.c
+
+The output is a drop-in replacement for english.c; the report goes to
+stderr.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FALSE (0)
+#define TRUE (!0)
+
+#include "english.c"
+
+#define NUM_RULESETS ((int)(sizeof(Rules) / sizeof(Rules[0])))
+#define MAX_RULES 256 //  per table
+#define SPAN 64       //  character positions tracked around a match
+#define ORIGIN 24     //  where the match starts within them
+
+typedef unsigned char Charset[32]; //  one bit per character
+
+typedef struct _shape {
+    Charset at[SPAN]; //  characters accepted at each position
+    int fixed;        //  TRUE if the whole rule has a fixed width
+} Shape;
+
+static unsigned long Tried[NUM_RULESETS][MAX_RULES];
+static unsigned long Hits[NUM_RULESETS][MAX_RULES];
+
+static void set_all(Charset s)
+{
+    memset(s, 0xff, sizeof(Charset));
+}
+
+static void set_only(Charset s, char *chars)
+{
+    memset(s, 0, sizeof(Charset));
+    for (; *chars; chars++)
+        s[(unsigned char)*chars >> 3] |= 1 << (*chars & 7);
+}
+
+static int is_text(char c)
+{
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '\'' ||
+           c == ' ';
+}
+
+/* Narrow one position by a context symbol.  Returns FALSE when the symbol
+has variable width and nothing further out can be said. */
+static int narrow(Shape *sh, int pos, char pat, int right)
+{
+    char one[2];
+
+    if (pos < 0 || pos >= SPAN) {
+        sh->fixed = FALSE;
+        return FALSE;
+    }
+    if (is_text(pat)) {
+        one[0] = pat;
+        one[1] = '\0';
+        set_only(sh->at[pos], one);
+        return TRUE;
+    }
+    sh->fixed = FALSE; //  until shown otherwise
+    switch (pat) {
+        case '^':
+            set_only(sh->at[pos], "BCDFGHJKLMNPQRSTVWXYZ");
+            sh->fixed = TRUE;
+            return TRUE;
+        case '.':
+            set_only(sh->at[pos], "BDVGJLMNRWZ");
+            sh->fixed = TRUE;
+            return TRUE;
+        case '+':
+            set_only(sh->at[pos], "EIY");
+            sh->fixed = TRUE;
+            return TRUE;
+        case '#':
+            set_only(sh->at[pos], "AEIOU");
+            return FALSE;
+        case '%':
+            if (right)
+                set_only(sh->at[pos], "EI");
+            return FALSE;
+        default: //  ':' or a bad character
+            return FALSE;
+    }
+}
+
+static void shape_of(Rule *rule, Shape *sh)
+{
+    char *left, *match, *right, one[2];
+    int pos, i, fixed;
+
+    for (pos = 0; pos < SPAN; pos++)
+        set_all(sh->at[pos]);
+
+    one[1] = '\0';
+    match = (*rule)[1];
+    for (i = 0; match[i]; i++) {
+        one[0] = match[i];
+        set_only(sh->at[ORIGIN + i], one);
+    }
+
+    fixed = TRUE;
+    sh->fixed = TRUE;
+    right = (*rule)[2];
+    for (pos = ORIGIN + i; *right; right++, pos++) {
+        if (!narrow(sh, pos, *right, TRUE))
+            break;
+    }
+    fixed = fixed && sh->fixed;
+
+    sh->fixed = TRUE;
+    left = (*rule)[0];
+    for (i = (int)strlen(left) - 1, pos = ORIGIN - 1; i >= 0; i--, pos--) {
+        if (!narrow(sh, pos, left[i], FALSE))
+            break;
+    }
+    sh->fixed = fixed && sh->fixed;
+}
+
+//  TRUE if no character string can satisfy both shapes.
+static int disjoint(Shape *a, Shape *b)
+{
+    int pos, i;
+
+    for (pos = 0; pos < SPAN; pos++) {
+        for (i = 0; i < (int)sizeof(Charset); i++) {
+            if (a->at[pos][i] & b->at[pos][i])
+                break;
+        }
+        if (i == (int)sizeof(Charset))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+//  TRUE if everything b accepts, fixed-width a accepts too.
+static int covers(Shape *a, Shape *b)
+{
+    int pos, i;
+
+    if (!a->fixed)
+        return FALSE;
+    for (pos = 0; pos < SPAN; pos++) {
+        for (i = 0; i < (int)sizeof(Charset); i++) {
+            if (b->at[pos][i] & ~a->at[pos][i])
+                return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static void read_profile(char *name)
+{
+    FILE *file;
+    char line[256];
+    int type, n;
+    unsigned long tried, hits;
+
+    file = fopen(name, "r");
+    if (file == 0) {
+        fprintf(stderr, "Error: Cannot open profile %s.\n", name);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%d %d %lu %lu", &type, &n, &tried, &hits) != 4 ||
+            type < 0 || type >= NUM_RULESETS || n < 0 || n >= MAX_RULES) {
+            fprintf(stderr, "Error: Bad line in profile %s: %s", name, line);
+            exit(1);
+        }
+        Tried[type][n] += tried;
+        Hits[type][n] += hits;
+    }
+    fclose(file);
+}
+
+static void put_part(char *s, int context)
+{
+    if (context && *s == '\0')
+        printf("Anything");
+    else if (context && strcmp(s, " ") == 0)
+        printf("Nothing");
+    else if (!context && *s == '\0')
+        printf("Silent");
+    else
+        printf("\"%s\"", s);
+}
+
+static char *table_name(int type)
+{
+    static char name[16];
+
+    if (type == 0)
+        return "punct_rules";
+    sprintf(name, "%c_rules", 'A' + type - 1);
+    return name;
+}
+
+//  Reorder one table, printing it; returns the number of dead rules.
+static int optimize(int type)
+{
+    static Shape shape[MAX_RULES];
+    Rule *rules;
+    int count, i, j, best, dead, placed[MAX_RULES], order[MAX_RULES], n;
+
+    rules = Rules[type];
+    for (count = 0; rules[count][1] != 0; count++) {
+        if (count == MAX_RULES - 1) {
+            fprintf(stderr, "Error: %s has too many rules.\n", table_name(type));
+            exit(1);
+        }
+        shape_of(&rules[count], &shape[count]);
+    }
+
+    //  Dead rules: covered by some earlier rule
+    dead = 0;
+    for (j = 0; j < count; j++) {
+        placed[j] = FALSE;
+        for (i = 0; i < j; i++) {
+            if (!placed[i] && covers(&shape[i], &shape[j])) {
+                fprintf(stderr, "%s: rule %d {\"%s\", \"%s\", \"%s\"} is dead, "
+                                "shadowed by rule %d\n",
+                        table_name(type), j, rules[j][0], rules[j][1],
+                        rules[j][2], i);
+                placed[j] = TRUE; //  i.e. dropped
+                if (Hits[type][j] != 0)
+                    fprintf(stderr, "    (but the profile has %lu hits for it!)\n",
+                            Hits[type][j]);
+                dead++;
+                break;
+            }
+        }
+    }
+
+    /* Hottest first: repeatedly take the most hit rule that no earlier,
+    still unplaced, overlapping rule has to precede. */
+    for (n = 0; n < count - dead; n++) {
+        best = -1;
+        for (j = 0; j < count; j++) {
+            if (placed[j])
+                continue;
+            for (i = 0; i < j; i++) {
+                if (!placed[i] && !disjoint(&shape[i], &shape[j]))
+                    break;
+            }
+            if (i < j)
+                continue; //  must stay behind rule i
+            if (best < 0 || Hits[type][j] > Hits[type][best])
+                best = j;
+        }
+        order[n] = best;
+        placed[best] = TRUE;
+    }
+
+    printf("/*\n**\tLEFT_PART\tMATCH_PART\tRIGHT_PART\tOUT_PART\n*/\n");
+    printf("static Rule %s[] =\n\t{\n", table_name(type));
+    for (n = 0; n < count - dead; n++) {
+        i = order[n];
+        printf("\t{");
+        put_part(rules[i][0], TRUE);
+        printf(",\t\"%s\",\t", rules[i][1]);
+        put_part(rules[i][2], TRUE);
+        printf(",\t");
+        put_part(rules[i][3], FALSE);
+        printf("\t},\t/* %lu */\n", Hits[type][i]);
+    }
+    printf("\t{Anything,\t0,\t\tAnything,\tSilent\t},\n\t};\n\n");
+    return dead;
+}
+
+int main(argc, argv) int argc;
+char *argv[];
+{
+    int type, i, dead;
+
+    for (i = 1; i < argc; i++)
+        read_profile(argv[i]);
+
+    printf("/* english.c reordered by ruleopt from rule profiles; comment is hits. */\n\n");
+    printf("static char Anything[] = \"\";\t/* No context requirement */\n");
+    printf("static char Nothing[] = \" \";\t/* Context is beginning or end of word */\n");
+    printf("static char Silent[] = \"\";\t/* No phonemes */\n\n");
+    printf("typedef char *Rule[4];\t/* Rule is an array of 4 character pointers */\n\n");
+
+    dead = 0;
+    for (type = 0; type < NUM_RULESETS; type++)
+        dead += optimize(type);
+
+    printf("Rule *Rules[] =\n\t{\n\t");
+    for (type = 0; type < NUM_RULESETS; type++) {
+        printf("%s%s", table_name(type), type + 1 < NUM_RULESETS ? ", " : "\n");
+        if (type % 7 == 0 && type + 1 < NUM_RULESETS)
+            printf("\n\t");
+    }
+    printf("\t};\n");
+
+    fprintf(stderr, "%d dead rules removed\n", dead);
+    return 0;
+}
@@ -0,0 +1,65 @@
+/* Compiled rule pack, shared by packgen (which writes it) and tx2al (which
+builds one from english.c at startup, or maps one with -u and uses it in
+place).  It is the packed rule arena pack_rules() describes, as one block:
+
+    Packhead                at offset 0
+    unsigned short []       match, left, right, out, lcode, rcode, at shorts
+    unsigned char []        mlen, llen, rlen, olen, lclass, rclass, lbyte,
+                            rbyte, at bytes
+    char text[]             rule strings and opcodes, at text
+    unsigned char code[]    context programs, at code
+    Packphoneme phoneme[]   the allophone table it was resolved with
+
+Each array holds count entries, one per rule, tables back to back from
+first[type].  Everything is an offset into the block, so it works
+wherever it is mapped; outputs are SPO256 opcodes without any bias.  The
+byte order is the building machine's; the magic number catches a
+mismatch. */
+
+#define PACK_MAGIC 0x5032414cU //  "LA2P" little endian
+#define PACK_VERSION 1
+#define PACK_TABLES 27 //  punct_rules, A_rules .. Z_rules
+
+typedef struct _packhead {
+    unsigned int magic, version;
+    unsigned int count;                  //  rules in all tables
+    unsigned int first[PACK_TABLES + 1]; //  first rule of each table
+    unsigned int shorts, bytes, text, code, phonemes; //  offsets
+    unsigned int nphonemes, size;        //  allophone table entries, length
+} Packhead;
+
+typedef struct _packphoneme {
+    char name[2]; //  "IY", or "p" and a NUL
+    unsigned char op, spare;
+} Packphoneme;
+
+/*
+**    Context bytecode.
+**
+**    Every non-empty left and right context is compiled once, by
+**    compile_context(), into a short program in code[].  Runs of plain
+**    text become a single CTX_LIT op compared a machine word at a time; the
+**    special symbols get one op each.  Left programs are laid out in the
+**    order they are matched (right to left), with each literal run kept in
+**    text order so it can be compared in one go.  Offset 0 holds an empty
+**    program and marks "no context".
+*/
+
+#define CTX_END 0    //  pattern matched
+#define CTX_LIT 1    //  n, then n bytes of text (n <= CTX_RUN)
+#define CTX_VOWELS 2 //  #  one or more vowels
+#define CTX_CONS0 3  //  :  zero or more consonants
+#define CTX_CONS1 4  //  ^  one consonant
+#define CTX_VOICED 5 //  .  one of B, D, V, G, J, L, M, N, R, W, Z
+#define CTX_FRONT 6  //  +  one of E, I, Y
+#define CTX_SUFFIX 7 //  %  one of ER, E, ES, ED, ING, ELY
+#define CTX_FAIL 8   //  bad pattern character, never matches
+
+#define CTX_RUN 8 //  longest literal run per op (see CONTEXT_PAD)
+
+//  Character classes, as the rule signatures (lclass, rclass) use them
+#define CC_VOWEL 1
+#define CC_CONSONANT 2
+#define CC_VOICED 4
+#define CC_FRONT 8
+#define CC_BLANK 16
@@ -1,11 +1,14 @@
 /* Prototypes created for t2a.c */
 
-void outallo(char *);		/* [tomj] new function */
 int is_punct(char);		/* [tomj] new function */
 void have_punct(void);		/* [tomj] new function */
 
-void outstring(char *);
 void outchar(int);
+void outbytes(unsigned char *, int);
+void outspan(Span *);
+void use_sink(Sink *);
+void outrule(int);
+void resolve_outputs(void);
 int makeupper(int);
 char new_char(void);
 void xlate_file(void);
@@ -17,11 +20,30 @@ void abbrev(char *);
 int isvowel(char);
 int isconsonant(char);
 void xlate_word(char *);
+void *pack_rules(unsigned long *);
+unsigned long rules_hash(void);
+void report_unknown_phonemes(void);
+void build_rule_index(void);
+Rulepack *load_rule_pack(char *);
+void use_rule_pack(Rulepack *);
+int reload_rules(char *);
+void watch_rule_pack(void);
+void check_generated_rules(void);
+void build_vector_match(void);
+void build_rule_automaton(void);
+void report_filter(void);
+void start_cache(int);
+void report_cache(void);
+void load_lexicon(char *);
+void start_peephole(char *);
+void peephole_done(void);
+void report_output(void);
+void start_fast_speech(void);
+void start_profile(void);
+void write_profile(FILE *);
+void start_trace(void);
+void write_trace(void);
 int find_rule(char *, int, Rule *);
-int leftmatch(char *, char *);
-int rightmatch(char *, char *);
-void say_cardinal(long int);
-void say_ordinal(long int);
 void say_ascii(int);
 void spell_word(char *);
 
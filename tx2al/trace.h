@@ -0,0 +1,41 @@
+/* Rule trace, shared by tx2al (built with TRACE_RULES, run with -e) and
+tracedump (which prints it).  While a word matching -e's pattern goes
+through the rules, every candidate rule and what became of it is put in a
+ring of fixed size records, the oldest overwritten first; at exit the
+ring is saved to tx2al.trc:
+
+    Tracehead               at offset 0
+    Tracerec ring[]         TRACE_RECORDS of them, written modulo
+
+A word starts with TR_WORD (its length and first four characters, blanks
+around it included), continued by TR_TEXT records of four more each, then
+one record per rule tried.  Traced words bypass the word cache.  Rule
+numbers are packed rule numbers (see rulepack.h), so the decoder needs
+the same rules: english.c, or the pack given with -u. */
+
+#define TRACE_MAGIC 0x5432414cU //  "LA2T" little endian
+#define TRACE_VERSION 1
+#define TRACE_RECORDS 8192      //  a power of two
+#define TRACE_FILE "tx2al.trc"
+
+#define TR_WORD 1      //  arg: length, text: its first characters
+#define TR_TEXT 2      //  text: the next four
+#define TR_SIGNATURE 3 //  rule at arg rejected by its signature
+#define TR_LEFT 4      //  ... by its left context
+#define TR_RIGHT 5     //  ... by its right context
+#define TR_FIRED 6     //  rule at arg spoken
+#define TR_NO_RULE 7   //  nothing fitted at arg
+#define TR_LEXICON 8   //  word found in the lexicon
+
+typedef struct _tracehead {
+    unsigned int magic, version;
+    unsigned int records;         //  TRACE_RECORDS
+    unsigned int written_lo, written_hi; //  records ever written
+} Tracehead;
+
+typedef struct _tracerec {
+    unsigned char kind;   //  TR_
+    unsigned char arg;    //  position in the padded word, or length
+    unsigned short rule;  //  packed rule number
+    char text[4];
+} Tracerec;
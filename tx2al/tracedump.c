@@ -0,0 +1,215 @@
+/*
+tracedump -- print the rule trace tx2al -e leaves in tx2al.trc.
+
+For each traced word, every rule tried on it: where in the word (blanks
+around it counted), which table and which rule of it, the rule itself as
+left[match]right, and whether it fired or what stopped it.  Rules are
+looked up by packed number, so give the pack tx2al ran with, if it ran
+with -u; otherwise the english.c compiled in here is packed the way tx2al
+packs it.  When the ring wrapped, what is left of the oldest word is
+skipped.
+
+    cl tracedump.c
+    tracedump tx2al.trc (english.pack)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define FALSE (0)
+#define TRUE (!0)
+
+#include "english.c"
+#include "allophones.c"
+#include "rulepack.h"
+
+#define NUM_RULESETS ((int)(sizeof(Rules) / sizeof(Rules[0])))
+
+#include "packrules.c"
+#include "trace.h"
+
+static unsigned char *Image;
+static Packhead *Head;
+
+//  Read a whole file, or say why not.
+static unsigned char *read_file(char *name, unsigned long *size)
+{
+    FILE *file;
+    unsigned char *p;
+    long n;
+
+    file = fopen(name, "rb");
+    if (file == 0) {
+        fprintf(stderr, "Error: Cannot open %s.\n", name);
+        exit(1);
+    }
+    fseek(file, 0, SEEK_END);
+    n = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    p = malloc(n > 0 ? n : 1);
+    if (p == 0) {
+        fputs("Error: Out of memory.\n", stderr);
+        exit(3);
+    }
+    if (n < 0 || fread(p, 1, n, file) != (size_t)n) {
+        fprintf(stderr, "Error: Cannot read %s.\n", name);
+        exit(1);
+    }
+    fclose(file);
+    *size = (unsigned long)n;
+    return p;
+}
+
+//  The table a packed rule is in, and its number there.
+static int rule_table(int id, int *within)
+{
+    int type;
+
+    for (type = 0; type < NUM_RULESETS - 1; type++) {
+        if (id < (int)Head->first[type + 1])
+            break;
+    }
+    *within = id - (int)Head->first[type];
+    return type;
+}
+
+//  Packed rule id as left[match]right, the left context put back in order.
+static void print_rule(int id)
+{
+    unsigned short *shorts;
+    unsigned char *bytes;
+    char *text, *left;
+    int n, type, within;
+
+    shorts = (unsigned short *)(Image + Head->shorts);
+    bytes = Image + Head->bytes;
+    text = (char *)(Image + Head->text);
+
+    type = rule_table(id, &within);
+    if (type == 0)
+        printf("punct %3d  ", within);
+    else
+        printf("%c %3d      ", 'A' + type - 1, within);
+
+    left = &text[shorts[Head->count + id]];
+    for (n = bytes[Head->count + id]; n > 0; n--)
+        putchar(left[n - 1]);
+    printf("[%s]%s", &text[shorts[id]], &text[shorts[2 * Head->count + id]]);
+}
+
+//  The phonemes a packed rule says, by name.
+static void print_phonemes(int id)
+{
+    unsigned short *shorts;
+    unsigned char *bytes, *op;
+    Packphoneme *ph;
+    unsigned int i;
+    int n;
+
+    shorts = (unsigned short *)(Image + Head->shorts);
+    bytes = Image + Head->bytes;
+    op = Image + Head->text + shorts[3 * Head->count + id];
+    for (n = bytes[3 * Head->count + id]; n > 0; n--, op++) {
+        ph = (Packphoneme *)(Image + Head->phonemes);
+        for (i = 0; i < Head->nphonemes && ph->op != *op; i++, ph++)
+            ;
+        if (i < Head->nphonemes)
+            printf(" %.2s", ph->name);
+        else
+            printf(" #%d", *op);
+    }
+}
+
+int main(argc, argv) int argc;
+char *argv[];
+{
+    unsigned long size, written, count, i;
+    unsigned char *trace;
+    Tracehead *th;
+    Tracerec *ring, *r;
+    int in_word;
+
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Try:\n    tracedump tx2al.trc (english.pack)\n");
+        exit(0);
+    }
+
+    trace = read_file(argv[1], &size);
+    th = (Tracehead *)trace;
+    if (size < sizeof(Tracehead) || th->magic != TRACE_MAGIC ||
+        th->version != TRACE_VERSION ||
+        size != sizeof(Tracehead) + th->records * sizeof(Tracerec)) {
+        fprintf(stderr, "Error: %s is not a tx2al rule trace.\n", argv[1]);
+        exit(1);
+    }
+    ring = (Tracerec *)(trace + sizeof(Tracehead));
+
+    if (argc == 3) {
+        Image = read_file(argv[2], &size);
+        Head = (Packhead *)Image;
+        if (size < sizeof(Packhead) || Head->magic != PACK_MAGIC ||
+            Head->version != PACK_VERSION || Head->size != size) {
+            fprintf(stderr, "Error: %s is not a rule pack.\n", argv[2]);
+            exit(1);
+        }
+    } else {
+        Head = pack_rules(&size);
+        Image = (unsigned char *)Head;
+    }
+
+    //  Oldest record first
+    written = th->written_lo; //  more than 4G records is not a trace to print
+    count = written < th->records ? written : th->records;
+    in_word = FALSE;
+    for (i = written - count; i < written; i++) {
+        r = &ring[i & (th->records - 1)];
+        if (!in_word && r->kind != TR_WORD)
+            continue; //  its word was lost to the wrap
+        if (r->kind != TR_WORD && r->kind != TR_TEXT && r->rule >= Head->count) {
+            fprintf(stderr, "Error: Rule %d isn't in these rules; wrong pack?\n",
+                    r->rule);
+            exit(1);
+        }
+        switch (r->kind) {
+            case TR_WORD:
+                printf("%s\"%.4s", in_word ? "\n" : "", r->text);
+                in_word = 2;
+                break;
+            case TR_TEXT:
+                if (in_word == 2)
+                    printf("%.4s", r->text);
+                break;
+            default:
+                if (in_word == 2)
+                    printf("\"\n");
+                in_word = TRUE;
+                printf("  %3d  ", r->arg);
+                switch (r->kind) {
+                    case TR_SIGNATURE:
+                    case TR_LEFT:
+                    case TR_RIGHT:
+                    case TR_FIRED:
+                        print_rule(r->rule);
+                        break;
+                }
+                switch (r->kind) {
+                    case TR_SIGNATURE: printf("  no: neighbours\n"); break;
+                    case TR_LEFT: printf("  no: left context\n"); break;
+                    case TR_RIGHT: printf("  no: right context\n"); break;
+                    case TR_FIRED:
+                        printf("  fired:");
+                        print_phonemes(r->rule);
+                        putchar('\n');
+                        break;
+                    case TR_NO_RULE: printf("no rule fits\n"); break;
+                    case TR_LEXICON: printf("in the lexicon\n"); break;
+                    default: printf("? record kind %d\n", r->kind); break;
+                }
+        }
+    }
+    if (in_word == 2)
+        printf("\"\n");
+    return 0;
+}
@@ -4,13 +4,65 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
 
 #define FALSE (0)
 #define TRUE (!0)
 typedef char *Rule[4]; //  A rule is four character pointers
-
-#include "t2a.h"     //  prototypes mainly
-#include "english.c" //  less messy than inline source
+typedef struct _span { //  Opcodes ready to output, see resolve_phonemes()
+    unsigned char *op;
+    int len;
+} Span;
+
+typedef struct _rulepack Rulepack; //  see load_rule_pack()
+
+#define MAX_DIGITS 21 //  longest number with a name, see say_number()
+typedef struct _number {
+    char digit[MAX_DIGITS]; //  significant digits not said yet
+    int len;
+    int streamed;           //  TRUE once some groups have been said
+} Number;
+
+//  Other words numbers are said with, see Number_words[]
+#define NW_HUNDRED 0
+#define NW_HUNDREDTH 1
+#define NW_AND 2 //  three thousand and five
+#define NW_POINT 3
+#define NW_DOLLAR 4
+#define NW_DOLLARS 5
+#define NW_CENTS_AND 6
+#define NW_CENT 7
+#define NW_CENTS 8
+#define NW_GROUP 9 //  between digit groups of a long run
+#define NW_COUNT 10
+
+static Span Number_word_ops[NW_COUNT]; //  filled in by resolve_outputs()
+
+#include "tx2al.h"      //  the library's interface, see t2a_new()
+#include "t2a.h"        //  prototypes mainly
+#include "english.c"    //  less messy than inline source
+#include "allophones.c" //  phoneme names to SPO256 opcodes (p2a)
+#include "lexicon.h"    //  compiled lexicon layout, see load_lexicon()
+#include "rulepack.h"   //  compiled rule layout, see load_rule_pack()
+#include "trace.h"      //  rule trace records, see trace_word()
+
+#define NUM_RULESETS ((int)(sizeof(Rules) / sizeof(Rules[0])))
+
+#include "packrules.c" //  Rules[] to a rule pack, shared with packgen
 
 char bias = 0; //  added to allophone value before output to file
 
@@ -114,13 +166,187 @@ is included with a #include statement).
 */
 
 #define MAX_LENGTH 128
+#define CONTEXT_PAD 16 //  slack around a word for multi-byte context compares
+#define WORD_SPAN (CONTEXT_PAD + MAX_LENGTH + 4 + CONTEXT_PAD)
+
+/* Per-word context index, built by word_info() once xlate_word() has the
+uppercased, blank-padded word.  Everything is indexed by position in the
+padded copy 'text' (the word itself starts at CONTEXT_PAD): the character
+class bits, and how far the run of vowels / consonants through each
+position reaches to the left and to the right (0 when it is not one). */
+typedef struct _wordinfo {
+    char *word; //  the word, inside text
+    char *text;
+    unsigned char *cls;
+    unsigned short *vowels_left, *vowels_right;
+    unsigned short *cons_left, *cons_right;
+    void *heap; //  storage for words longer than WORD_SPAN
+    char text_buf[WORD_SPAN];
+    unsigned char cls_buf[WORD_SPAN];
+    unsigned short run_buf[4 * WORD_SPAN];
+} Wordinfo;
+
+/* Word cache: see cache_lookup().  While xlate_word() runs the rules on a
+word that missed, outchar() also copies the allophones to capture_buf. */
+#define CACHE_KEY (MAX_LENGTH + 4) //  longest word kept
+#define CACHE_VALUE 256            //  most allophones kept per word
+
+static void word_info(Wordinfo *, char *);
+static void word_done(Wordinfo *);
+static int try_rule(int, Wordinfo *, int);
+static void number_start(Number *);
+static void number_digit(Number *, int);
+static int number_is_one(Number *);
+static void say_number(Number *, int);
+static void say_chunk(int, int);
+static void write_out(unsigned char *, int);
+static void end_phrase(void);
+static void xlate_tokens(void);
+static void feed_text(t2a_context *, const char *, unsigned long, int);
+static void peephole_end(void);
+static int is_vowel_allophone(int);
+static void ac_scan(char *);
+static void speak_word(char *);
+static void flush_cache(void);
+static void enter_rules(void);
+static void leave_rules(void);
+static void check_reload(void);
+static double now_ms(void);
+static int lowest_bit(unsigned long long);
+
+#ifndef T2A_LIBRARY //  the command line's, see main()
+static void start_output(void);
+static void finish_output(void);
+static void report_stream(void);
+static void start_stats(void);
+static void report_stats(void);
+#ifdef SIGHUP
+static void on_hangup(int);
+#endif
 
-static FILE *In_file;  //  text input
 static FILE *Out_file; //  phonemes out
-static char *In_data;
+static Sink File_sink; //  ... by way of this, see start_output()
+static char *Peep_file; //  -m or -w, see peephole()
+static int Stats;       //  --stats, see report_stats()
+#endif
+
+#ifdef GENERATED_RULES
+static int Use_generated = TRUE; //  compiled rules in use (see find_rule)
+#else
+static int Use_generated = FALSE;
+#endif
+static int Report_filter = FALSE;       //  -f, see report_filter()
+static int Use_vector;                  //  -v, see vector_rule()
+static int Use_ac;                      //  -a, see ac_rule()
+static FILE *Profile_file;              //  -p, see write_profile()
+static int Cache_entries = 4096;        //  -c, see cache_lookup()
+static int Fast_speech;                 //  -s, see start_fast_speech()
+static unsigned char Fast_map[64];      //  opcode to its fast stand-in
+static char *Pack_file;                 //  -u, see load_rule_pack()
+static char *Trace_pattern;             //  -e, see trace_word()
+static int Streaming;                   //  --stream, see end_phrase()
+
+//  What the program is doing, for --stats
+#define ST_STARTUP 0
+#define ST_INPUT 1
+#define ST_TOKENIZE 2
+#define ST_RULES 3
+#define ST_NUMBERS 4
+#define ST_OUTPUT 5
+#define ST_COUNT 6
+
+/*
+**    Contexts.
+**
+**    Everything a translation changes as it goes is kept in a t2a_context:
+**    the input window, the output and what is held back of it, the word
+**    cache, the peephole window, the counters and the rule pack in use.
+**    The rule tables, the indexes over them and the other tables
+**    resolve_outputs() fills in are made once, by t2a_init(), and only
+**    read after that, so any number of contexts can translate at once,
+**    each on its own thread.  T is the context this thread is translating
+**    for: every t2a_ call makes its context current, and the command line
+**    is a context like any other (see main()).  The settings the options
+**    make are the process's and are made before t2a_init().
+*/
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+#define PEEP_RULE 8 //  longest pattern or replacement, see peephole()
+#define PEEP_WINDOW (2 * PEEP_RULE)
+
+struct _t2a_context {
+    Sink *out;              //  where what is said goes, see write_out()
+    int started;            //  text has been fed since t2a_new() or t2a_finish()
+    volatile sig_atomic_t stage; //  ST_, for --stats
+
+    //  Input, see fill_input()
+    FILE *in_file;
+    int ch;                 //  the character in hand, see ahead()
+    char *in_ptr, *in_end;  //  the window, ch is *in_ptr
+    int in_eof;             //  in_end is the end of the input
+    char *in_buf;           //  blocks read, for input that isn't mapped
+    unsigned long in_size;  //  ... and its size
+    char *in_map;           //  a regular file mapped whole
+    unsigned long in_mapped; //  ... and its size
+    int in_push;            //  text is pushed, see t2a_feed()
+    int in_starved;         //  ... and a token wanted more than there was
+    unsigned long in_wait;  //  ... the window it had then, see feed_text()
+    char *in_fresh;         //  --stream: where the last block read starts
+    double in_ms[2];        //  ... when the one before it and it arrived
+
+    //  Output, see write_out()
+    unsigned long out_count, out_ms; //  with -f, see report_output()
+    int holding;            //  output held back, see xlate_tokens()
+    unsigned char *held;
+    int held_len, held_size;
+    int phrase_held;        //  a phrase ended in the held output
+    unsigned char peep_window[PEEP_WINDOW + PEEP_RULE]; //  see peephole()
+    int peep_len;
+    int peep_pause;         //  ms of silence held back
+    int peep_sounds;        //  TRUE once anything but silence went out
+    unsigned long peep_in, peep_out, peep_ms_in, peep_ms_out;
+    unsigned long phrases, phrase_start; //  --stream, out_count at its start
+    double latency_sum, latency_max;
+
+    //  Words, see speak_word()
+    Rulepack *pack;         //  the rules in use
+    int reader;             //  its slot, see enter_rules()
+    Wordinfo *cur_word;     //  index of the word xlate_word() is working on
+    int capturing, capture_len; //  see cache_insert()
+    unsigned char capture_buf[CACHE_VALUE];
+    int cache_size;         //  entries in the slab, 0 = no cache
+    int cache_used, cache_hand;
+    unsigned long cache_mask; //  slots - 1
+    int *cache_slot;        //  entry, or -1 when free
+    char *cache_key;        //  [entry * CACHE_KEY]
+    unsigned char *cache_value; //  [entry * CACHE_VALUE]
+    unsigned char *cache_keylen, *cache_ref;
+    short *cache_vallen;
+    unsigned long *cache_hashes;
+    short *ac_found;        //  see ac_scan()
+    unsigned char *ac_nfound;
+    int ac_room;
+    unsigned long *prof_tried, *prof_hits; //  -p, see start_profile()
+    int tracing;            //  the word in hand is being traced
+    Tracerec *trace_ring;   //  see trace_record()
+    unsigned long long trace_written;
+
+    //  Counts, for -f and --stats
+    unsigned long cache_hits, cache_misses;
+    unsigned long sig_tried, sig_rejected, ctx_rejected;
+    unsigned long st_chars, st_words, st_numbers, st_punct;
+    unsigned long st_find_rule, st_no_rule, st_left, st_right;
+};
 
-static int Char, Char1, Char2, Char3;
+static THREAD_LOCAL t2a_context *T; //  the context translating, see above
 
+
+#ifndef T2A_LIBRARY
 /*
 ** main(argc, argv)
 **    int argc;
@@ -128,12 +354,17 @@ static int Char, Char1, Char2, Char3;
 **
 **    This is the main program.  It takes up to two file names (input
 **    and output)  and translates the input file to phoneme codes
-**    (see english.c) on the output file.
+**    (see english.c) on the output file.  The translating is done by
+**    one context, as a program using the library would (see tx2al.h).
+**    Built with T2A_LIBRARY, there is no main().
 */
 int main(argc, argv) int argc;
 char *argv[];
 {
     int i; //  [tomj]
+    FILE *in;
+    char *text = 0;
+    t2a_context *t;
 
     if (argc < 2) {
         fprintf(stderr, "\nTry:\n");
@@ -156,11 +387,29 @@ char *argv[];
                 "www.wps.com and elsewhere.\n");
         fprintf(stderr, "\nTry:\n");
         fprintf(stderr, "    t2a (-i infile) (-o outfile) (-t \"literal text used as infile\"\n");
+        fprintf(stderr, "    -r uses the rule interpreter instead of compiled rules\n");
+        fprintf(stderr, "    -f reports rule prefilter and word cache hit rates and output\n");
+        fprintf(stderr, "       length and playback time on stderr (implies -r)\n");
+        fprintf(stderr, "    -v finds rules with vector compares instead of the trie (implies -r)\n");
+        fprintf(stderr, "    -a finds rules with one Aho-Corasick pass per word (implies -r)\n");
+        fprintf(stderr, "    -p profile writes per-rule attempt/hit counts for ruleopt\n");
+        fprintf(stderr, "    -c n keeps n translated words in a cache (default 4096, 0 = off)\n");
+        fprintf(stderr, "    -l lexicon looks words up in a lexicon built by lexgen first\n");
+        fprintf(stderr, "    -s fast speech: shorter allophones, single vowels, brief pauses\n");
+        fprintf(stderr, "    -m merges pauses and trims leading and trailing silence\n");
+        fprintf(stderr, "    -w rules does -m and applies allophone rewrite rules too\n");
+        fprintf(stderr, "    -u pack uses the rules in a pack built by packgen, reloading them\n");
+        fprintf(stderr, "       when the file changes or on SIGHUP\n");
+        fprintf(stderr, "    --stats writes counts and time spent in each stage to stderr\n");
+        fprintf(stderr, "    --stream writes each phrase out as soon as it ends, reporting how\n");
+        fprintf(stderr, "       long after its input arrived on stderr\n");
+        fprintf(stderr, "    -e pattern traces the rules tried for words like pattern (* and ?)\n");
+        fprintf(stderr, "       into tx2al.trc, for tracedump; TRACE_RULES builds only\n");
         fprintf(stderr, "    stdin and/or stdout are used if files not specified\n");
         exit(0);
     }
 
-    In_file = stdin;
+    in = stdin;
     Out_file = stdout;
 
     i = 1;
@@ -168,8 +417,8 @@ char *argv[];
         if (argv[i][0] == '-') {
             switch (toupper(argv[i][1])) { //  process options
                 case 'I':
-                    In_file = fopen(argv[i + 1], "r");
-                    if (In_file == 0) {
+                    in = fopen(argv[i + 1], "r");
+                    if (in == 0) {
                         fputs("Error: Cannot open input file.\n", stderr);
                         exit(1);
                     }
@@ -182,788 +431,3530 @@ char *argv[];
                     }
                     break;
                 case 'T':
-                    In_data = &argv[i + 1][0];
-                    In_file = 0;
+                    text = &argv[i + 1][0];
+                    in = 0;
+                    break;
+                case 'R': //  interpret the rule tables
+                    Use_generated = FALSE;
+                    break;
+                case 'V': //  vector match strings instead of the trie
+                    Use_vector = TRUE;
+                    Use_generated = FALSE; //  rules_gen.c doesn't search
+                    break;
+                case 'A': //  one Aho-Corasick pass per word
+                    Use_ac = TRUE;
+                    Use_generated = FALSE; //  rules_gen.c doesn't search
+                    break;
+                case 'F': //  report rule prefilter hit rate
+                    Report_filter = TRUE;
+                    Use_generated = FALSE; //  rules_gen.c has no prefilter
+                    break;
+                case 'P': //  per-rule counts for ruleopt
+                    Profile_file = fopen(argv[i + 1], "w");
+                    if (Profile_file == 0) {
+                        fputs("Error: Cannot create profile file.\n", stderr);
+                        exit(2);
+                    }
+                    Use_generated = FALSE; //  counts come from the interpreter
+                    break;
+                case 'C': //  word cache size, 0 for none
+                    Cache_entries = atoi(argv[i + 1]);
+                    break;
+                case 'L': //  exception dictionary
+                    load_lexicon(argv[i + 1]);
+                    break;
+                case 'S': //  fast speech
+                    start_fast_speech();
+                    break;
+                case 'M': //  merge and trim pauses
+                    Peep_file = "";
+                    break;
+                case 'W': //  ... and rewrite allophones too
+                    Peep_file = argv[i + 1];
+                    break;
+                case 'U': //  rules from a pack, not english.c
+                    use_rule_file(argv[i + 1]);
+                    break;
+                case 'E': //  trace the rules some words go through
+                    Trace_pattern = argv[i + 1];
+                    Use_generated = FALSE; //  it is the interpreter that traces
+                    break;
+                case '-':
+                    if (strcmp(argv[i], "--stats") == 0)
+                        Stats = TRUE;
+                    else if (strcmp(argv[i], "--stream") == 0)
+                        Streaming = TRUE;
                     break;
             }
         }
         ++i;
     }
-
-    xlate_file(); //  translate file
+    if (Stats)
+        start_stats();
+    if (Trace_pattern)
+        start_trace();
+    if (Peep_file)
+        start_peephole(*Peep_file ? Peep_file : 0);
+    t2a_init();
+#ifdef SIGHUP
+    if (Pack_file && !Profile_file)
+        signal(SIGHUP, on_hangup); //  see check_reload()
+#endif
+    start_output();
+
+    t = t2a_new(&File_sink); //  the reports below are of it
+    if (in) {
+        t2a_file(t, in); //  translate file
+    } else {
+        feed_text(t, text, strlen(text), TRUE); //  all of it at once
+        t2a_finish(t);
+    }
+    if (Peep_file)
+        peephole_done();
+    finish_output();
+
+    if (Report_filter) {
+        report_filter();
+        report_cache();
+        report_output();
+    }
+    if (Profile_file)
+        write_profile(Profile_file);
+    if (Stats)
+        report_stats();
+    if (Trace_pattern)
+        write_trace();
+    if (Streaming)
+        report_stream();
 
     return 0;
 }
+#endif
 
-//  General Instrument SP0256-AL2 phonemes
+/* Resolved output.  Rule outputs and the number and character name tables
+are turned into opcodes, bias added, once at startup (open_pack() and
+resolve_outputs()), so speaking one is a single outbytes() and a phoneme
+missing from p2a is reported once, when the tables are loaded, rather than
+every time it would have been said. */
 
-/* This table contains the GI phonemes and their numeric values. The text is
-the phoneme name generated by John Wasser's PHONEME program, the numeric
-values are the GI opcodes.
+//  Make n unbiased opcodes at op ready to output, in place; returns how many.
+static int speakable(unsigned char *op, int n)
+{
+    int i, k, a;
 
-The PHONEME software uses only a subset of the SPO256-AL2's
-opcodes. These were hand-mapped, and will likely get filled
-in and opcode use expanded later.
-*/
+    for (i = k = 0; i < n; i++) {
+        a = op[i];
+        if (Fast_speech) { //  quicker stand-in, doubled vowels said once
+            a = Fast_map[a];
+            if (k > 0 && op[k - 1] == a + bias && is_vowel_allophone(a))
+                continue;
+        }
+        op[k++] = (unsigned char)(a + bias);
+    }
+    return k;
+}
 
-struct _p2a {
-    char *phoneme;
-    char allophone;
-} p2a[] = {
-    {"IY", 0x13}, //  see
-    {"IH", 0x0c}, //  sit
-    {"EY", 0x14}, //  beige
-    {"EH", 0x07}, //  end, get
-    {"AE", 0x1a}, //  fat
-    {"AA", 0x18}, //  hot (father?)
-    {"AO", 0x17}, //  aught, lawn
-    {"OW", 0x35}, //  lone, beau
-    {"UH", 0x1e}, //  full, book
-    {"UW", 0x1f}, //  food, fool
-    {"ER", 0x34}, //  fir, murder
-    {"AX", 0x0f}, //  suck, about
-    {"AH", 0x0f}, //  but
-    {"AY", 0x06}, //  sky, hide
-    {"AW", 0x20}, //  out, how
-    {"OY", 0x05}, //  boy
-
-    {"h", 0x1b},  //  he
-    {"p", 0x09},  //  pow, pack
-    {"b", 0x3f},  //  business, back
-    {"t", 0x0d},  //  to, time
-    {"d", 0x21},  //  do, dime
-    {"k", 0x2a},  //  sky
-    {"g", 0x24},  //  got, goat
-    {"f", 0x28},  //  fault, food
-    {"v", 0x23},  //  vest, vault
-    {"TH", 0x1d}, //  ether, thin
-    {"DH", 0x36}, //  they, either
-    {"s", 0x37},  //  vest, Sue
-    {"z", 0x2b},  //  zoo
-    {"SH", 0x25}, //  ship, leash
-    {"ZH", 0x26}, //  azure, leisure
-    {"HH", 0x39}, //  hoe, how
-    {"m", 0x10},  //  milk, sum
-    {"n", 0x0b},  //  thin, sun
-    {"NG", 0x2c}, //  sung, anchor
-    {"l", 0x2d},  //  lake, laugh
-    {"w", 0x2e},  //  wear, wool
-    {"y", 0x19},  //  yes, young
-    {"r", 0x33},  //  rate
-    {"CH", 0x32}, //  church, char
-    {"j", 0x0a},  //  jar, dodge
-    {"WH", 0x30}, //  whig, where
-    {"P1", 0x00}, //  pause, 10ms
-    {"P2", 0x01}, //  pause, 30ms
-    {"P3", 0x02}, //  pause, 50ms
-    {"P4", 0x03}, //  pause, 100ms
-    {"P5", 0x04}, //  pause, 200ms
-
-    {"R1", 0x27}, //  reed
-    {"T1", 0x11}, //  part
-    {"EY", 0x36}, //  they
-    {"D1", 0x15}, //  could
-    {"U1", 0x16}, //  to
-    {"G3", 0x22}, //  wig
-    {"RR", 0x0e}, //  brain
-    {"K2", 0x08}, //  comb
-    {"K1", 0x29}, //  cant
-    {"XR", 0x2f}, //  pair
-    {"Y1", 0x31}, //  yes
-    {"R2", 0x34}, //  fir
-    {"N2", 0x38}, //  no
-    {"OR", 0x3a}, //  store
-    {"AR", 0x3b}, //  alarm
-    {"YR", 0x3c}, //  clear
-    {"G2", 0x3d}, //  guest
-    {"EL", 0x3e}, //  saddle
-    {"B2", 0x1c}, //  caleb
-    {"DT", 0x12}, //  they
-    {"", 0}       //  end of table
-};
+//  A phoneme string as output opcodes; never more than strlen(s) of them.
+static int resolve_phonemes(char *s, unsigned char *op)
+{
+    return speakable(op, phoneme_codes(s, op));
+}
 
-/* Given a string of phonemes, output General Instrument SPO256-AL2 allophones,
- * with an ASCII bias. */
+/*
+**    Fast speech.
+**
+**    For alerts, where getting it said matters more than how it sounds, -s
+**    shortens everything as it is resolved: each allophone becomes the
+**    quickest one the chip has for that sound (Fast_allophones[] in
+**    allophones.c), the vowels english.c doubles for intelligibility are
+**    said once, and spelled letters get a P2 between them instead of a P4.
+**    -f reports output length and estimated playback time to compare.
+*/
 
-void outallo(s) char *s;
+void start_fast_speech()
 {
-    struct _p2a *t;
-    char *q, phoneme[3];
+    int i;
 
-    q = s;       //  save for error report
-    while (*s) { //  until string is exhausted,
-        if (*s == ' ') {
-            ++s;
-            continue;
-        }
-        if (isupper(*s)) { //  upper case phonemes are two chars long,
-            phoneme[0] = *s++;
-            phoneme[1] = *s++;
-            phoneme[2] = '\0';
-        } else { //  lower case phonemes are one char long
-            phoneme[0] = *s++;
-            phoneme[1] = '\0';
-        }
+    for (i = 0; i < 64; i++)
+        Fast_map[i] = (unsigned char)i;
+    for (i = 0; i < (int)(sizeof(Fast_allophones) / sizeof(Fast_allophones[0])); i++)
+        Fast_map[Fast_allophones[i][0]] = Fast_allophones[i][1];
+    Fast_speech = TRUE;
+}
 
-        for (t = p2a; *t->phoneme; ++t) { //  search the table for it
-            if (strcmp(t->phoneme, phoneme) == 0) {
-                outchar(t->allophone + bias);
-                break;
-            }
-        }
-        if (!*(t->phoneme)) {
-            fprintf(stderr,
-                    "Phoneme \"%s\" in string \"%s\" not in allophone table!\n",
-                    phoneme, q);
-        }
+static int is_vowel_allophone(int a)
+{
+    return memchr(Vowel_allophones, a, sizeof(Vowel_allophones)) != 0;
+}
+
+void outbytes(op, len) unsigned char *op;
+int len;
+{
+    if (T->capturing) { //  keep a copy for the word cache
+        if (T->capture_len + len <= CACHE_VALUE)
+            memcpy(&T->capture_buf[T->capture_len], op, len);
+        T->capture_len += len;
     }
+    write_out(op, len);
 }
 
-void outstring(string) char *string;
+void outspan(span) Span *span;
 {
-    if (!*string)
-        return;
-    outallo(string);
+    outbytes(span->op, span->len);
 }
 
-char inchar()
+/*
+**    Peephole pass.
+**
+**    With -m everything said goes through peephole() on its way to the
+**    output file.  Runs of pauses are held back and merged into the
+**    fewest P1..P5 that last as long; silence before the first sound and
+**    after the last one is dropped; and rewrite rules from a -w file are
+**    applied to what's left, in a window a few allophones long.  A rules
+**    file has one rule a line, in phonemes as english.c spells them:
+**
+**        # two long vowels in a row are one
+**        AA AA = AA
+**        P4 P4 = P4
+**
+**    peephole_done() flushes the window and reports bytes and (estimated)
+**    playback time saved.
+*/
+
+typedef struct _peeprule {
+    unsigned char from[PEEP_RULE], to[PEEP_RULE];
+    int from_len, to_len;
+} Peeprule;
+
+static int Peephole; //  -m, see peephole()
+static Peeprule *Peep_rules;
+static int Peep_count, Peep_longest;
+
+//  Fewest pauses making up each multiple of 10 ms, by dynamic programming
+#define PEEP_SPAN 40 //  up to 400 ms; longer runs start with P5s
+static unsigned char Pause_count[PEEP_SPAN + 1], Pause_first[PEEP_SPAN + 1];
+
+static int is_pause(int c)
 {
-    if (In_file) return getc(In_file);
-    if (*In_data) return *In_data++;
-    return EOF;
+    return (unsigned char)(c - bias) <= 4; //  PA1..PA5
 }
 
-void outchar(int chr)
+static int duration(int c)
 {
-    fputc(chr, Out_file);
+    return Allo_ms[(unsigned char)(c - bias) & 0x3f];
 }
 
-int makeupper(character) int character;
+//  One side of a rewrite rule to opcodes; returns how many.
+static int peep_phonemes(char *s, unsigned char *op, char *name, int line)
 {
-    if (islower(character))
-        return toupper(character);
-    else
-        return character;
+    char phoneme[3];
+    int n, a;
+
+    for (n = 0; next_phoneme(&s, phoneme); n++) {
+        a = allophone(phoneme);
+        if (a < 0 || n == PEEP_RULE) {
+            fprintf(stderr, "Error: %s:%d: bad phoneme \"%s\" or rule too long.\n",
+                    name, line, phoneme);
+            exit(1);
+        }
+        op[n] = (unsigned char)(a + bias);
+    }
+    return n;
 }
 
-char new_char()
+static void peep_rules(char *name)
 {
-    /*
-  If the cache is full of newline, time to prime the look-ahead
-  again.  If an EOF is found, fill the remainder of the queue with
-  EOF's.
-  */
-    if (Char == '\n' && Char1 == '\n' && Char2 == '\n' &&
-        Char3 == '\n') { //  prime the pump again
-        Char = inchar();
-        if (Char == EOF) {
-            Char1 = EOF;
-            Char2 = EOF;
-            Char3 = EOF;
-            return Char;
+    FILE *file;
+    char line[256], *p, *eq;
+    Peeprule *r;
+    int n;
+
+    file = fopen(name, "r");
+    if (file == 0) {
+        fputs("Error: Cannot open rewrite rules file.\n", stderr);
+        exit(1);
+    }
+    for (n = 1; fgets(line, sizeof(line), file); n++) {
+        line[strcspn(line, "#\r\n")] = '\0';
+        for (p = line; *p; p++) {
+            if (*p == '\t')
+                *p = ' ';
         }
-        if (Char == '\n')
-            return Char;
-
-        Char1 = inchar();
-        if (Char1 == EOF) {
-            Char2 = EOF;
-            Char3 = EOF;
-            return Char;
+        eq = strchr(line, '=');
+        if (eq == 0) {
+            if (line[strspn(line, " ")] == '\0')
+                continue;
+            fprintf(stderr, "Error: %s:%d: rewrite rule needs an '='.\n", name, n);
+            exit(1);
         }
-        if (Char1 == '\n')
-            return Char;
+        *eq = '\0';
 
-        Char2 = inchar();
-        if (Char2 == EOF) {
-            Char3 = EOF;
-            return Char;
+        Peep_rules = realloc(Peep_rules, (Peep_count + 1) * sizeof(Peeprule));
+        if (Peep_rules == 0) {
+            fputs("Error: Out of memory for rewrite rules.\n", stderr);
+            exit(3);
         }
-        if (Char2 == '\n')
-            return Char;
-
-        Char3 = inchar();
-    } else {
-        /*
-    Buffer not full of newline, shuffle the characters and
-    either get a new one or propagate a newline or EOF.
-    */
-        Char = Char1;
-        Char1 = Char2;
-        Char2 = Char3;
-        if (Char3 != '\n' && Char3 != EOF)
-            Char3 = inchar();
+        r = &Peep_rules[Peep_count++];
+        r->from_len = peep_phonemes(line, r->from, name, n);
+        r->to_len = peep_phonemes(eq + 1, r->to, name, n);
+        if (r->from_len == 0) {
+            fprintf(stderr, "Error: %s:%d: empty rewrite pattern.\n", name, n);
+            exit(1);
+        }
+        if (r->from_len > Peep_longest)
+            Peep_longest = r->from_len;
     }
-    return Char;
+    fclose(file);
 }
 
-/*
-** xlate_file()
-**
-**    This is the input file translator.  It sets up the first character
-**    and uses it to determine what kind of text follows.
-*/
-void xlate_file()
+void start_peephole(char *rules)
 {
-    //  Prime the queue
-    Char = '\n';
-    Char1 = '\n';
-    Char2 = '\n';
-    Char3 = '\n';
-    new_char(); //  Fill Char, Char1, Char2 and Char3
-
-    while (Char != EOF) //  All of the words in the file
-    {
-        if (isdigit(Char))
-            have_number();
-        else if (isalpha(Char) || Char == '\'')
-            have_letter();
-        else if (is_punct(Char))
-            have_punct();
-        else if (Char == '$' && isdigit(Char1))
-            have_dollars();
-        else
-            have_special();
+    static int ms[] = {10, 30, 50, 100, 200};
+    int t, i, d;
+
+    if (rules)
+        peep_rules(rules);
+
+    for (t = 1; t <= PEEP_SPAN; t++) {
+        Pause_count[t] = 255;
+        for (i = 0; i < 5; i++) {
+            d = ms[i] / 10;
+            if (d <= t && Pause_count[t - d] + 1 < Pause_count[t]) {
+                Pause_count[t] = Pause_count[t - d] + 1;
+                Pause_first[t] = (unsigned char)i;
+            }
+        }
     }
+    Peephole = TRUE;
 }
 
-/* [tomj] Speak punctuation. Because punctuation is expressed only as pauses in
-speaking, we
-suppress multiple punctuation characters, speaking only the first one found. */
-
-void have_punct()
+static void peep_emit(int len)
 {
-    char buff[3];
-    sprintf(buff, "%c ", Char);   //  format as required by find_rule(),
-    find_rule(buff, 0, Rules[0]); //  speak it (one charact er);
-    for (new_char(); is_punct(Char); new_char())
-        ; //  gobble and throw away further punctuation
+    int i;
+
+    for (i = 0; i < len; i++)
+        T->peep_ms_out += duration(T->peep_window[i]);
+    T->peep_out += len;
+    sink_put(T->out, T->peep_window, len);
+    T->peep_len -= len;
+    memmove(T->peep_window, T->peep_window + len, T->peep_len);
 }
 
-//  [tomj] Return true if the current character is punctuation.
-
-int is_punct(char c)
+//  Rewrite the end of the window while some rule matches there.
+static void peep_rewrite()
 {
-    switch (c) {
-        case '.':
-        case ',':
-        case ':':
-        case ';':
-        case '!':
-        case '?':
-        case '-':
-            return (TRUE);
-        default:
-            return (FALSE);
+    Peeprule *r;
+    int tries, i;
+
+    for (tries = 0; tries < PEEP_RULE; tries++) {
+        for (i = 0, r = Peep_rules; i < Peep_count; i++, r++) {
+            if (r->from_len <= T->peep_len &&
+                memcmp(T->peep_window + T->peep_len - r->from_len, r->from,
+                       r->from_len) == 0)
+                break;
+        }
+        if (i == Peep_count)
+            return;
+        if (T->peep_len - r->from_len + r->to_len > (int)sizeof(T->peep_window))
+            return; //  a rule that grows can't keep on growing
+        T->peep_len -= r->from_len;
+        memcpy(T->peep_window + T->peep_len, r->to, r->to_len);
+        T->peep_len += r->to_len;
     }
 }
 
-void have_dollars()
+static void peep_add(int c)
+{
+    T->peep_window[T->peep_len++] = (unsigned char)c;
+    if (Peep_count)
+        peep_rewrite();
+    if (T->peep_len >= PEEP_WINDOW) //  keep enough for the longest pattern
+        peep_emit(T->peep_len - Peep_longest);
+}
+
+static void peephole(unsigned char *op, int len)
 {
-    long int value;
+    int t;
 
-    value = 0L;
-    for (new_char(); isdigit(Char) || Char == ','; new_char()) {
-        if (Char != ',')
-            value = 10 * value + (Char - '0');
+    for (; len--; op++) {
+        T->peep_in++;
+        T->peep_ms_in += duration(*op);
+        if (is_pause(*op)) {
+            T->peep_pause += duration(*op);
+            continue;
+        }
+        if (T->peep_pause && T->peep_sounds) { //  the fewest pauses that long
+            for (t = T->peep_pause / 10; t > PEEP_SPAN; t -= 20)
+                peep_add(4 + bias);
+            for (; t > 0; t -= duration(Pause_first[t] + bias) / 10)
+                peep_add(Pause_first[t] + bias);
+        }
+        T->peep_pause = 0; //  leading silence just goes
+        T->peep_sounds = TRUE;
+        peep_add(*op);
     }
+}
 
-    say_cardinal(value); //  Say number of whole dollars
+void report_output()
+{
+    fprintf(stderr, "output: %lu allophones, about %lu.%02lu s to say%s\n",
+            T->out_count, T->out_ms / 1000, T->out_ms % 1000 / 10,
+            Fast_speech ? " (fast speech)" : "");
+}
 
-    //  Found a character that is a non-digit and non-comma
+//  Let the last of the window out.
+static void peephole_end()
+{
+    peep_emit(T->peep_len); //  trailing silence stays behind
+    T->peep_pause = 0;
+}
 
-    //  Check for no decimal or no cents digits
-    if (Char != '.' || !isdigit(Char1)) {
-        if (value == 1L)
-            outstring("dAAlER ");
-        else
-            outstring("dAAlAArz ");
-        return;
-    }
+void peephole_done()
+{
+    long saved;
+    char *sign;
+
+    peephole_end();
+
+    saved = (long)T->peep_ms_in - (long)T->peep_ms_out; //  -w rules may add
+    sign = saved < 0 ? "-" : "";
+    if (saved < 0)
+        saved = -saved;
+    fprintf(stderr, "peephole: %lu allophones in, %lu out, %ld bytes saved, "
+                    "about %s%ld.%02ld s of %lu.%02lu s playback saved\n",
+            T->peep_in, T->peep_out, (long)T->peep_in - (long)T->peep_out, sign,
+            saved / 1000, saved % 1000 / 10,
+            T->peep_ms_in / 1000, T->peep_ms_in % 1000 / 10);
+}
 
-    //  We have '.' followed by a digit
+/*
+**    Output sinks.
+**
+**    Everything said goes to the context's sink: a contiguous buffer that
+**    write_out() appends to with a memcpy, and what happens when it fills.
+**
+**        sink_file()      a file descriptor, written SINK_BLOCK at a time;
+**                         a span that won't fit goes out with the buffer
+**                         in one writev()
+**        sink_memory()    the caller's buffer, or with none one that grows;
+**                         the output is left in buf[0..len)
+**        sink_callback()  spans handed to a function as the buffer fills
+**                         and at each sink_flush()
+**
+**    A write that fails sets failed and later output is dropped; a fixed
+**    buffer that fills counts what didn't fit in lost.
+*/
 
-    new_char(); //  Skip the period
+#define SINK_FILE 0
+#define SINK_MEMORY 1 //  fixed, the caller's
+#define SINK_GROW 2
+#define SINK_CALLBACK 3
 
-    //  If it is ".dd " say as " DOLLARS AND n CENTS "
-    if (isdigit(Char1) && !isdigit(Char2)) {
-        if (value == 1L)
-            outstring("dAAlER ");
-        else
-            outstring("dAAlAArz ");
-        if (Char == '0' && Char1 == '0') {
-            new_char(); //  Skip tens digit
-            new_char(); //  Skip units digit
-            return;
-        }
+#define SINK_BLOCK 65536
 
-        outstring("AAnd ");
-        value = (Char - '0') * 10 + Char1 - '0';
-        say_cardinal(value);
+static unsigned char *sink_buffer(unsigned long size)
+{
+    unsigned char *p;
 
-        if (value == 1L)
-            outstring("sEHnt ");
-        else
-            outstring("sEHnts ");
-        new_char(); //  Used Char (tens digit)
-        new_char(); //  Used Char1 (units digit)
-        return;
+    p = malloc(size);
+    if (p == 0) {
+        fputs("Error: Out of memory.\n", stderr);
+        exit(3);
     }
+    return p;
+}
 
-    //  Otherwise say as "n POINT ddd DOLLARS "
-
-    outstring("pOYnt ");
-    for (; isdigit(Char); new_char()) {
-        say_ascii(Char);
+//  Write p[0..len) and then q[0..qlen) to the sink's descriptor.
+static void sink_write(Sink *s, unsigned char *p, unsigned long len,
+                       unsigned char *q, unsigned long qlen)
+{
+    long n;
+#ifndef _WIN32
+    struct iovec iov[2];
+#endif
+
+    while (!s->failed && len + qlen > 0) {
+#ifdef _WIN32
+        if (len == 0) { //  no writev(), one span at a time
+            p = q;
+            len = qlen;
+            qlen = 0;
+        }
+        n = _write(s->fd, p, (unsigned int)len);
+#else
+        iov[0].iov_base = p;
+        iov[0].iov_len = len;
+        iov[1].iov_base = q;
+        iov[1].iov_len = qlen;
+        n = (long)writev(s->fd, iov, 2);
+        if (n < 0 && errno == EINTR)
+            continue;
+#endif
+        if (n <= 0) {
+            s->failed = TRUE;
+            break;
+        }
+        if ((unsigned long)n >= len) { //  into the second span
+            n -= (long)len;
+            p = q + n;
+            len = qlen - n;
+            q = 0;
+            qlen = 0;
+        } else {
+            p += n;
+            len -= n;
+        }
     }
-
-    outstring("dAAlAArz ");
-
-    return;
 }
 
-void have_special()
+void sink_file(Sink *s, int fd)
 {
-    if (Char == '\n')
-        outchar('\n');
-    else if (!isspace(Char))
-        say_ascii(Char);
-
-    new_char();
-    return;
+    memset(s, 0, sizeof(Sink));
+    s->kind = SINK_FILE;
+    s->fd = fd;
+    s->size = SINK_BLOCK;
+    s->buf = sink_buffer(s->size);
 }
 
-void have_number()
+/* Collect the output in buf, size bytes, or with buf 0 in a buffer that
+grows as needed (sink_close() frees it). */
+void sink_memory(Sink *s, unsigned char *buf, unsigned long size)
 {
-    long int value;
-    int lastdigit;
-
-    value = Char - '0';
-    lastdigit = Char;
-
-    for (new_char(); isdigit(Char); new_char()) {
-        value = 10 * value + (Char - '0');
-        lastdigit = Char;
+    memset(s, 0, sizeof(Sink));
+    if (buf) {
+        s->kind = SINK_MEMORY;
+        s->buf = buf;
+        s->size = size;
+    } else {
+        s->kind = SINK_GROW;
+        s->size = 4096;
+        s->buf = sink_buffer(s->size);
     }
+}
 
-    //  Recognize ordinals based on last digit of number
-    switch (lastdigit) {
-        case '1': //  ST
-            if (makeupper(Char) == 'S' && makeupper(Char1) == 'T' &&
-                !isalpha(Char2) && !isdigit(Char2)) {
-                say_ordinal(value);
-                new_char(); //  Used Char
-                new_char(); //  Used Char1
-                return;
-            }
-            break;
+void sink_callback(Sink *s, void (*fn)(void *, unsigned char *, unsigned long),
+                   void *arg)
+{
+    memset(s, 0, sizeof(Sink));
+    s->kind = SINK_CALLBACK;
+    s->fn = fn;
+    s->arg = arg;
+    s->size = SINK_BLOCK;
+    s->buf = sink_buffer(s->size);
+}
 
-        case '2': //  ND
-            if (makeupper(Char) == 'N' && makeupper(Char1) == 'D' &&
-                !isalpha(Char2) && !isdigit(Char2)) {
-                say_ordinal(value);
-                new_char(); //  Used Char
-                new_char(); //  Used Char1
-                return;
-            }
-            break;
+//  What sink_put() does when the span doesn't fit.
+static void sink_overflow(Sink *s, unsigned char *op, unsigned long len)
+{
+    unsigned long room;
 
-        case '3': //  RD
-            if (makeupper(Char) == 'R' && makeupper(Char1) == 'D' &&
-                !isalpha(Char2) && !isdigit(Char2)) {
-                say_ordinal(value);
-                new_char(); //  Used Char
-                new_char(); //  Used Char1
+    switch (s->kind) {
+        case SINK_FILE:
+            sink_write(s, s->buf, s->len, op, len);
+            s->len = 0;
+            return;
+        case SINK_CALLBACK:
+            if (s->len)
+                s->fn(s->arg, s->buf, s->len);
+            s->len = 0;
+            if (len >= s->size) { //  too big to gather, hand it on as it is
+                s->fn(s->arg, op, len);
                 return;
             }
             break;
-
-        case '0': //  TH
-        case '4': //  TH
-        case '5': //  TH
-        case '6': //  TH
-        case '7': //  TH
-        case '8': //  TH
-        case '9': //  TH
-            if (makeupper(Char) == 'T' && makeupper(Char1) == 'H' &&
-                !isalpha(Char2) && !isdigit(Char2)) {
-                say_ordinal(value);
-                new_char(); //  Used Char
-                new_char(); //  Used Char1
-                return;
+        case SINK_GROW:
+            while (s->size - s->len < len)
+                s->size *= 2;
+            s->buf = realloc(s->buf, s->size);
+            if (s->buf == 0) {
+                fputs("Error: Out of memory.\n", stderr);
+                exit(3);
             }
             break;
+        case SINK_MEMORY:
+            room = s->size - s->len;
+            s->lost += len - room;
+            len = room;
+            break;
     }
+    memcpy(s->buf + s->len, op, len);
+    s->len += len;
+}
 
-    say_cardinal(value);
+void sink_put(Sink *s, unsigned char *op, unsigned long len)
+{
+    if (s->size - s->len >= len) {
+        memcpy(s->buf + s->len, op, len);
+        s->len += len;
+    } else
+        sink_overflow(s, op, len);
+}
 
-    //  Recognize decimal points
-    if (Char == '.' && isdigit(Char1)) {
-        outstring("pOYnt ");
-        for (new_char(); isdigit(Char); new_char()) {
-            say_ascii(Char);
-        }
-    }
+//  Pass on what a file or callback sink is holding.
+void sink_flush(Sink *s)
+{
+    if (s->len == 0)
+        return;
+    if (s->kind == SINK_FILE)
+        sink_write(s, s->buf, s->len, 0, 0);
+    else if (s->kind == SINK_CALLBACK)
+        s->fn(s->arg, s->buf, s->len);
+    else
+        return; //  memory sinks keep it
+    s->len = 0;
+}
 
-    //  Spell out trailing abbreviations
-    if (isalpha(Char)) {
-        while (isalpha(Char)) {
-            say_ascii(Char);
-            new_char();
-        }
-    }
+//  Flush the sink and free any buffer it allocated.
+void sink_close(Sink *s)
+{
+    sink_flush(s);
+    if (s->kind != SINK_MEMORY)
+        free(s->buf);
+    s->buf = 0;
+    s->len = s->size = 0;
+}
 
-    return;
+//  Send everything this thread's context says from now on to s.
+void use_sink(Sink *s)
+{
+    T->out = s;
 }
 
-void have_letter()
+#ifndef T2A_LIBRARY
+static void flush_output()
 {
-    char buff[MAX_LENGTH];
-    int count;
+    sink_flush(&File_sink);
+}
 
-    count = 0;
-    buff[count++] = ' '; //  Required initial blank
+//  Send the output to Out_file.
+static void start_output()
+{
+#ifdef _WIN32
+    sink_file(&File_sink, _fileno(Out_file));
+#else
+    sink_file(&File_sink, fileno(Out_file));
+#endif
+    atexit(flush_output); //  what was said before an error exit
+}
+
+//  Flush the output at the end, exiting if it couldn't all be written.
+static void finish_output()
+{
+    int was = T->stage;
+
+    T->stage = ST_OUTPUT;
+    sink_flush(&File_sink);
+    T->stage = was;
+    if (File_sink.failed) {
+        fputs("Error: Cannot write output file.\n", stderr);
+        exit(2);
+    }
+}
+#endif
 
-    buff[count++] = makeupper(Char);
 
-    for (new_char(); isalpha(Char) || Char == '\''; new_char()) {
-        buff[count++] = makeupper(Char);
-        if (count > MAX_LENGTH - 2) {
-            buff[count++] = ' ';
-            buff[count++] = '\0';
-            xlate_word(buff);
-            count = 1;
+static void hold_out(unsigned char *op, int len)
+{
+    if (T->held_len + len > T->held_size) {
+        while (T->held_len + len > T->held_size)
+            T->held_size = T->held_size ? T->held_size * 2 : 1024;
+        T->held = realloc(T->held, T->held_size);
+        if (T->held == 0) {
+            fputs("Error: Out of memory.\n", stderr);
+            exit(3);
         }
     }
+    memcpy(T->held + T->held_len, op, len);
+    T->held_len += len;
+}
 
-    buff[count++] = ' '; //  Required terminating blank
-    buff[count++] = '\0';
+//  Everything said goes out here.
+static void write_out(unsigned char *op, int len)
+{
+    int i, was = T->stage;
 
-    //  Check for AAANNN type abbreviations
-    if (isdigit(Char)) {
-        spell_word(buff);
+    if (T->holding) {
+        hold_out(op, len);
         return;
-    } else //  [tomj] "A" and "I" are words!
-        if ((strlen(buff) == 3) && (strcmp(buff, " I ") != 0) &&
-            (strcmp(buff, " A ") != 0)) //  one character, two spaces
-        say_ascii(buff[1]);
-    else if (Char == '.') //  Possible abbreviation
-        abbrev(buff);
+    }
+
+    T->stage = ST_OUTPUT;
+    T->out_count += len;
+    if (Report_filter) { //  what it would take to say
+        for (i = 0; i < len; i++)
+            T->out_ms += duration(op[i]);
+    }
+    if (Peephole)
+        peephole(op, len);
     else
-        xlate_word(buff);
+        sink_put(T->out, op, len);
+    T->stage = was;
+}
 
-    if (Char == '-' && isalpha(Char1))
-        new_char(); //  Skip hyphens
+/*
+**    Input.
+**
+**    The text is looked at through one contiguous window, in_ptr to in_end,
+**    rather than a character at a time: a regular file is mapped whole, and
+**    anything else (a pipe, a terminal, any input on Windows, where text
+**    mode turns CR LF into LF) is read into in_buf a block at a time, as
+**    text pushed with t2a_feed() is copied there.  ch is the character at
+**    in_ptr, and ahead(n) looks further on, so scanning a run of letters or
+**    digits is a pointer walking the buffer.  It reads as the original queue
+**    of four did: the input ends at its end or at the first 0xFF byte (a
+**    char that compares equal to EOF), and looking ahead past a newline
+**    sees newlines, so a line is never waited for before the one in hand is
+**    done.  fill_input() keeps the window at least four characters long, or
+**    up to a newline, until the input is used up.
+*/
+
+#define IN_BLOCK 65536
+
+//  Cut the window at an 0xFF byte in the newly arrived text from p.
+static void input_arrived(char *p)
+{
+    char *stop;
+
+    stop = memchr(p, 0xff, T->in_end - p);
+    if (stop) {
+        T->in_end = stop;
+        T->in_eof = TRUE;
+    }
+    T->st_chars += (unsigned long)(T->in_end - p);
 }
 
-//  Handle abbreviations.  Text in buff was followed by '.'
-void abbrev(buff) char buff[];
+//  Read on until the window is long enough (see above) or the input ends.
+static void fill_input()
 {
-    if (strcmp(buff, " DR ") == 0) {
-        xlate_word(" DOCTOR ");
-        new_char();
-    } else if (strcmp(buff, " MR ") == 0) {
-        xlate_word(" MISTER ");
-        new_char();
-    } else if (strcmp(buff, " MRS ") == 0) {
-        xlate_word(" MISSUS ");
-        new_char();
-    } else if (strcmp(buff, " PHD ") == 0) {
-        spell_word(" PHD ");
-        new_char();
-    } else
-        xlate_word(buff);
+    int was = T->stage;
+    long kept, n;
+
+    T->stage = ST_INPUT;
+    while (!T->in_eof && T->in_end - T->in_ptr < 4 &&
+           memchr(T->in_ptr, '\n', T->in_end - T->in_ptr) == 0) {
+        if (T->in_push) { //  no waiting, see t2a_feed()
+            T->in_starved = TRUE;
+            break;
+        }
+        kept = (long)(T->in_end - T->in_ptr); //  the last few, moved to the front
+        memmove(T->in_buf, T->in_ptr, kept);
+        T->in_ptr = T->in_buf;
+        T->in_end = T->in_buf + kept;
+        if (Streaming)
+            sink_flush(T->out); //  all that can be said before waiting
+#ifdef _WIN32
+        n = _read(_fileno(T->in_file), T->in_end, IN_BLOCK);
+#else
+        do
+            n = (long)read(fileno(T->in_file), T->in_end, IN_BLOCK);
+        while (n < 0 && errno == EINTR);
+#endif
+        if (n <= 0) { //  a read error ends the input, as it did getc()
+            T->in_eof = TRUE;
+            break;
+        }
+        T->in_end += n;
+        if (Streaming) {
+            T->in_fresh = T->in_end - n;
+            T->in_ms[0] = T->in_ms[1];
+            T->in_ms[1] = now_ms();
+        }
+        input_arrived(T->in_end - n);
+    }
+    T->stage = was;
 }
 
-//  !!! end of PARSE.C
+//  Set the window up on in_file.
+static void start_input()
+{
+#ifndef _WIN32
+    struct stat st;
+    off_t at;
+    char *p;
+#endif
+
+    T->in_ms[0] = T->in_ms[1] = now_ms();
+    T->in_eof = FALSE;
+#ifndef _WIN32
+    at = lseek(fileno(T->in_file), 0, SEEK_CUR); //  stdin need not be at the start
+    if (!Streaming && fstat(fileno(T->in_file), &st) == 0 && S_ISREG(st.st_mode) &&
+        at >= 0 && at < st.st_size) {
+        p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fileno(T->in_file), 0);
+        if (p != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+#endif
+            T->in_map = p;
+            T->in_mapped = (unsigned long)st.st_size;
+            T->in_ptr = p + at;
+            T->in_end = p + st.st_size;
+            T->in_eof = TRUE;
+            input_arrived(T->in_ptr);
+            return;
+        }
+    }
+#endif
+
+    if (T->in_size < IN_BLOCK + 4) { //  kept for the next file or push
+        T->in_size = IN_BLOCK + 4;
+        T->in_buf = realloc(T->in_buf, T->in_size);
+    }
+    if (T->in_buf == 0) {
+        fputs("Error: Out of memory.\n", stderr);
+        exit(3);
+    }
+    T->in_ptr = T->in_end = T->in_buf;
+    fill_input();
+}
+
+/* Move the input on to p, within the window or at its end.  Returns FALSE
+if p was the end of the window and more input may follow, so a run being
+scanned to there has to carry on from in_ptr; pushed text that ran out
+stops the run (see t2a_feed()). */
+static int input_at(char *p)
+{
+    int stopped;
+
+    stopped = p < T->in_end || T->in_eof;
+    T->in_ptr = p;
+    if (!T->in_eof && T->in_end - p < 4)
+        fill_input();
+    T->ch = T->in_ptr < T->in_end ? *T->in_ptr : EOF;
+    return stopped || T->in_starved;
+}
+
+//  The character n (1 to 3) after ch, as the queue of four would have it.
+static int ahead(int n)
+{
+    char *p;
+
+    for (p = T->in_ptr; p < T->in_ptr + n; p++) {
+        if (p >= T->in_end)
+            return EOF;
+        if (*p == '\n')
+            return '\n';
+    }
+    return p < T->in_end ? *p : EOF;
+}
 
 /*
-**    English to Phoneme translation.
-**
-**    Rules are made up of four parts:
-**
-**        The left context.
-**        The text to match.
-**        The right context.
-**        The phonemes to substitute for the matched text.
-**
-**    Procedure:
+**    Tokens.
 **
-**        Seperate each block of letters (apostrophes included)
-**        and add a space on each side.  For each unmatched
-**        letter in the word, look through the rules where the
-**        text to match starts with the letter in the word.  If
-**        the text to match is found and the right and left
-**        context patterns also match, output the phonemes for
-**        that rule and skip to the next unmatched letter.
+**    xlate_file() goes from token to token: the kind of text starting at
+**    ch is looked up in Tok_class (C locale classes, by byte, so 0x80
+**    and up are none of them), and a run of one kind is measured in one go
+**    by run_length(), which classifies 16 bytes at a time with SSE2 and
+**    finds where the run stops from the bitmask.  Letter runs are copied
+**    into the word buffer upper cased 16 at a time by fold_run().  Without
+**    SSE2 both go a byte at a time through Tok_class.
+*/
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TOK_SSE2
+#endif
+
+#define TK_LETTER 1 //  A-Z, a-z and '
+#define TK_DIGIT 2
+#define TK_PUNCT 4  //  is_punct()
+#define TK_BLANK 8  //  white space but newline
+
+static unsigned char Tok_class[256];
+
+static void start_tokens()
+{
+    int i;
+
+    for (i = 0; i < 128; i++) {
+        if (isalpha(i) || i == '\'')
+            Tok_class[i] = TK_LETTER;
+        else if (isdigit(i))
+            Tok_class[i] = TK_DIGIT;
+        else if (is_punct((char)i))
+            Tok_class[i] = TK_PUNCT;
+        else if (isspace(i) && i != '\n')
+            Tok_class[i] = TK_BLANK;
+    }
+}
+
+#ifdef TOK_SSE2
+//  0xff in each byte of v from lo to lo + n - 1
+static __m128i byte_range(__m128i v, int lo, int n)
+{
+    return _mm_cmplt_epi8(_mm_sub_epi8(v, _mm_set1_epi8((char)(lo + 128))),
+                          _mm_set1_epi8((char)(n - 128)));
+}
+
+//  Bitmask of the 16 bytes at p that are of the classes in kind.
+static int class_mask(const char *p, int kind)
+{
+    __m128i v, m;
+
+    v = _mm_loadu_si128((const __m128i *)p);
+    m = _mm_setzero_si128();
+    if (kind & TK_LETTER)
+        m = _mm_or_si128(m, _mm_or_si128(
+            byte_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 26),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('\''))));
+    if (kind & TK_DIGIT)
+        m = _mm_or_si128(m, byte_range(v, '0', 10));
+    if (kind & TK_PUNCT)
+        m = _mm_or_si128(m, _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('.')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8(','))),
+            _mm_or_si128(_mm_or_si128(byte_range(v, ':', 2), //  : ;
+                                      _mm_cmpeq_epi8(v, _mm_set1_epi8('!'))),
+                         _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('?')),
+                                      _mm_cmpeq_epi8(v, _mm_set1_epi8('-'))))));
+    if (kind & TK_BLANK)
+        m = _mm_or_si128(m, _mm_or_si128(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+            _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                             byte_range(v, '\t', 5)))); //  \t to \r
+    return _mm_movemask_epi8(m);
+}
+#endif
+
+//  How many characters from p on, up to in_end, are of the classes in kind.
+static int run_length(const char *p, int kind)
+{
+    const char *q;
+#ifdef TOK_SSE2
+    int m;
+
+    for (q = p; T->in_end - q >= 16; q += 16) {
+        m = class_mask(q, kind) ^ 0xffff;
+        if (m != 0)
+            return (int)(q - p) + lowest_bit(m);
+    }
+#else
+    q = p;
+#endif
+    for (; q < T->in_end && (Tok_class[(unsigned char)*q] & kind); q++)
+        ;
+    return (int)(q - p);
+}
+
+/* Copy n letters from the input at from to to, upper cased.  There is room
+for 16 at to, whatever n is: a short run is still copied in one vector if
+the input goes on far enough, and what follows it is scribbled over. */
+static void fold_run(char *to, const char *from, int n)
+{
+#ifdef TOK_SSE2
+    __m128i v;
+
+    for (; n > 0 && T->in_end - from >= 16; n -= 16, from += 16, to += 16) {
+        v = _mm_loadu_si128((const __m128i *)from);
+        v = _mm_sub_epi8(v, _mm_and_si128(byte_range(v, 'a', 26),
+                                          _mm_set1_epi8(0x20)));
+        _mm_storeu_si128((__m128i *)to, v);
+    }
+#endif
+    for (; n > 0; n--)
+        *to++ = (char)makeupper(*from++);
+}
+
+/*
+**    Streaming.
 **
+**    With --stream tx2al is a live filter: the output is flushed when a
+**    phrase ends (at punctuation or a newline, once its pause or newline
+**    is out) and before every read that may wait, so nothing that could
+**    be said is held back for more input.  Input is always read in blocks,
+**    never mapped, so memory stays the same however long the input runs.
+**    A line still waits for the two characters of lookahead the tokenizer
+**    needs unless a newline ends it.  Each phrase gets a "stream:" line on
+**    stderr saying how long after the read that brought its last character
+**    its allophones were written, and a total comes at the end.
+*/
+
+static void end_phrase()
+{
+    double ms;
+
+    if (T->holding) { //  once the token is through, see xlate_tokens()
+        T->phrase_held = TRUE;
+        return;
+    }
+    sink_flush(T->out);
+    ms = now_ms() - (T->in_ptr >= T->in_fresh ? T->in_ms[1] : T->in_ms[0]);
+    T->phrases++;
+    T->latency_sum += ms;
+    if (ms > T->latency_max)
+        T->latency_max = ms;
+    fprintf(stderr, "stream: phrase=%lu allophones=%lu latency_ms=%.3f\n",
+            T->phrases, T->out_count - T->phrase_start, ms);
+    T->phrase_start = T->out_count;
+}
+
+#ifndef T2A_LIBRARY
+static void report_stream()
+{
+    fprintf(stderr, "stream: total phrases=%lu mean_latency_ms=%.3f "
+                    "max_latency_ms=%.3f\n",
+            T->phrases, T->phrases ? T->latency_sum / T->phrases : 0.0,
+            T->latency_max);
+}
+#endif
+
+/*
+**    Push translation.
 **
-**    Special Context Symbols:
+**    An embedding program that gets its text in pieces hands them over as
+**    they come with t2a_feed() and ends with t2a_finish(); the allophones
+**    go to the context's sink as soon as they are settled.  Pushed text
+**    is added to in_buf and xlate_tokens() translates as far as it goes.
+**    fill_input() never waits for more: when a token wants text not fed
+**    yet it marks the input starved, and the token's output, held back by
+**    write_out() meanwhile, is dropped and the token done again from its
+**    first character once there is more.  A token that goes through saw
+**    just what it would have with the whole text at once, so how the text
+**    is cut up makes no difference to what is said.  So that a long token
+**    fed a little at a time isn't done over on every feed, feed_text() only
+**    tries it again once something that may end it has come, or it has
+**    twice the text it had last time.
+*/
+
+//  Translate what can be of the text pushed so far.
+static void push_tokens(t2a_context *t)
+{
+    T->stage = ST_TOKENIZE;
+    T->in_push = TRUE;
+    input_at(T->in_ptr);
+    xlate_tokens();
+    T->in_push = FALSE;
+    T->stage = ST_STARTUP;
+    sink_flush(t->out);
+}
+
+/* Whether text from p to the end of the window could end the starved
+token at the front of it: a newline, or a blank after a token that isn't
+blanks, or something else after one that is. */
+static int token_may_end(char *p)
+{
+    int blanks;
+
+    blanks = Tok_class[(unsigned char)*T->in_buf] == TK_BLANK;
+    for (; p < T->in_end; p++) {
+        if (*p == '\n' || (Tok_class[(unsigned char)*p] == TK_BLANK) != blanks)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* Translate len more characters of text, and if it is the last of it,
+the rest as well; see t2a_feed(). */
+static void feed_text(t2a_context *t, const char *text, unsigned long len,
+                      int last)
+{
+    unsigned long kept;
+
+    T = t;
+    if (!t->started) {
+        T->in_ptr = T->in_end = T->in_buf;
+        T->in_eof = FALSE;
+        T->in_wait = 0;
+        t->started = TRUE;
+    }
+    if (T->in_eof) //  past an 0xFF, which ends the text
+        return;
+
+    kept = (unsigned long)(T->in_end - T->in_ptr); //  a token not done yet
+    if (kept)
+        memmove(T->in_buf, T->in_ptr, kept);
+    if (kept + len > T->in_size) {
+        while (kept + len > T->in_size)
+            T->in_size = T->in_size ? T->in_size * 2 : IN_BLOCK;
+        T->in_buf = realloc(T->in_buf, T->in_size);
+        if (T->in_buf == 0) {
+            fputs("Error: Out of memory.\n", stderr);
+            exit(3);
+        }
+    }
+    memcpy(T->in_buf + kept, text, len);
+    T->in_ptr = T->in_buf;
+    T->in_end = T->in_buf + kept + len;
+    if (Streaming) {
+        T->in_fresh = T->in_buf + kept;
+        T->in_ms[0] = T->in_ms[1];
+        T->in_ms[1] = now_ms();
+    }
+    input_arrived(T->in_buf + kept);
+    if (last) //  no token waits for more
+        T->in_eof = TRUE;
+    if (!T->in_eof && T->in_wait && kept + len < 2 * T->in_wait &&
+        !token_may_end(T->in_buf + kept))
+        return; //  it would only starve again
+    push_tokens(t);
+}
+
+//  Translate len more characters of text.
+void t2a_feed(t2a_context *t, const char *text, unsigned long len)
+{
+    feed_text(t, text, len, FALSE);
+}
+
+//  The text is all there: translate the rest and flush it all out.
+void t2a_finish(t2a_context *t)
+{
+    T = t;
+    if (!t->started)
+        t2a_feed(t, "", 0);
+    T->in_eof = TRUE;
+    push_tokens(t);
+    if (Peephole) {
+        peephole_end();
+        sink_flush(t->out);
+    }
+    t->started = FALSE;
+}
+
+void outchar(int chr)
+{
+    unsigned char c;
+
+    if (T->capturing) { //  keep a copy for the word cache
+        if (T->capture_len < CACHE_VALUE)
+            T->capture_buf[T->capture_len] = (unsigned char)chr;
+        T->capture_len++;
+    }
+    c = (unsigned char)chr;
+    write_out(&c, 1);
+}
+
+int makeupper(character) int character;
+{
+    if (islower(character))
+        return toupper(character);
+    else
+        return character;
+}
+
+char new_char()
+{
+    if (T->in_ptr < T->in_end) //  at the end, stay there
+        input_at(T->in_ptr + 1);
+    return T->ch;
+}
+
+/*
+** xlate_file()
 **
-**        #    One or more vowels
-**        :    Zero or more consonants
-**        ^    One consonant.
-**        .    One of B, D, V, G, J, L, M, N, R, W or Z (voiced
-**            consonants)
-**        %    One of ER, E, ES, ED, ING, ELY (a suffix)
-**            (Right context only)
-**        +    One of E, I or Y (a "front" vowel)
+**    This is the input file translator.  It sets up the first character
+**    and uses it to determine what kind of text follows.
 */
+void xlate_file()
+{
+    T->stage = ST_TOKENIZE;
+
+    start_input();
+    input_at(T->in_ptr);
+    xlate_tokens();
+}
+
+//  Translate token by token to the end of the input, see push_tokens().
+static void xlate_tokens()
+{
+    char *start;
+
+    while (T->ch != EOF) //  All of the words in the file
+    {
+        start = T->in_ptr;
+        if (T->in_push) {
+            T->in_starved = FALSE;
+            T->holding = TRUE;
+        }
+        if (Pack_file && !Profile_file) { //  only a pack from a file reloads
+            check_reload();
+            enter_rules();
+        }
+        switch (Tok_class[(unsigned char)T->ch]) {
+            case TK_DIGIT: have_number(); break;
+            case TK_LETTER: have_letter(); break;
+            case TK_PUNCT: have_punct(); break;
+            default:
+                if (T->ch == '$' && isdigit(ahead(1)))
+                    have_dollars();
+                else
+                    have_special();
+                break;
+        }
+        if (Pack_file && !Profile_file)
+            leave_rules();
+        if (T->in_push) {
+            T->holding = FALSE;
+            if (T->in_starved) { //  again with more text
+                T->in_wait = (unsigned long)(T->in_end - start);
+                T->held_len = 0;
+                T->phrase_held = FALSE;
+                T->in_ptr = start;
+                T->ch = EOF;
+                return;
+            }
+            T->in_wait = 0;
+            write_out(T->held, T->held_len);
+            T->held_len = 0;
+            if (T->phrase_held) {
+                T->phrase_held = FALSE;
+                end_phrase();
+            }
+        }
+    }
+}
+
+/* [tomj] Speak punctuation. Because punctuation is expressed only as pauses in
+speaking, we
+suppress multiple punctuation characters, speaking only the first one found. */
+
+void have_punct()
+{
+    char buff[3];
+
+    T->st_punct++;
+    sprintf(buff, "%c ", T->ch);   //  format as required by find_rule(),
+    find_rule(buff, 0, Rules[0]); //  speak it (one charact er);
+    if (Streaming)
+        end_phrase();
+    new_char();
+    while (!input_at(T->in_ptr + run_length(T->in_ptr, TK_PUNCT)))
+        ; //  gobble and throw away further punctuation
+}
+
+//  [tomj] Return true if the current character is punctuation.
+
+int is_punct(char c)
+{
+    switch (c) {
+        case '.':
+        case ',':
+        case ':':
+        case ';':
+        case '!':
+        case '?':
+        case '-':
+            return (TRUE);
+        default:
+            return (FALSE);
+    }
+}
+
+void have_dollars()
+{
+    Number dollars;
+    int value;
+    char *p;
+
+    T->st_numbers++;
+
+    number_start(&dollars);
+    for (p = T->in_ptr + 1;; p = T->in_ptr) { //  digits and commas after the '$'
+        for (; p < T->in_end && (isdigit(*p) || *p == ','); p++) {
+            if (*p != ',')
+                number_digit(&dollars, *p);
+        }
+        if (input_at(p))
+            break;
+    }
+
+    say_number(&dollars, FALSE); //  Say number of whole dollars
+
+    //  Found a character that is a non-digit and non-comma
+
+    //  Check for no decimal or no cents digits
+    if (T->ch != '.' || !isdigit(ahead(1))) {
+        if (number_is_one(&dollars))
+            outspan(&Number_word_ops[NW_DOLLAR]);
+        else
+            outspan(&Number_word_ops[NW_DOLLARS]);
+        return;
+    }
+
+    //  We have '.' followed by a digit
+
+    new_char(); //  Skip the period
+
+    //  If it is ".dd " say as " DOLLARS AND n CENTS "
+    if (isdigit(ahead(1)) && !isdigit(ahead(2))) {
+        if (number_is_one(&dollars))
+            outspan(&Number_word_ops[NW_DOLLAR]);
+        else
+            outspan(&Number_word_ops[NW_DOLLARS]);
+        if (T->ch == '0' && ahead(1) == '0') {
+            new_char(); //  Skip tens digit
+            new_char(); //  Skip units digit
+            return;
+        }
+
+        outspan(&Number_word_ops[NW_CENTS_AND]);
+        value = (T->ch - '0') * 10 + ahead(1) - '0';
+        say_chunk(value, FALSE);
+
+        if (value == 1)
+            outspan(&Number_word_ops[NW_CENT]);
+        else
+            outspan(&Number_word_ops[NW_CENTS]);
+        new_char(); //  Used ch (tens digit)
+        new_char(); //  Used the next (units digit)
+        return;
+    }
+
+    //  Otherwise say as "n POINT ddd DOLLARS "
+
+    outspan(&Number_word_ops[NW_POINT]);
+    for (; isdigit(T->ch); new_char()) {
+        say_ascii(T->ch);
+    }
+
+    outspan(&Number_word_ops[NW_DOLLARS]);
+
+    return;
+}
+
+void have_special()
+{
+    if (T->ch == '\n') {
+        outchar('\n');
+        if (Streaming)
+            end_phrase();
+    } else if (Tok_class[(unsigned char)T->ch] == TK_BLANK) { //  the whole run
+        while (!input_at(T->in_ptr + run_length(T->in_ptr, TK_BLANK)))
+            ;
+        return;
+    } else if (!isspace(T->ch))
+        say_ascii(T->ch);
+
+    new_char();
+    return;
+}
+
+void have_number()
+{
+    Number value;
+    int lastdigit;
+    char *p;
+
+    T->st_numbers++;
+
+    number_start(&value);
+    lastdigit = T->ch;
+    for (p = T->in_ptr;; p = T->in_ptr) {
+        for (; p < T->in_end && isdigit(*p); p++) {
+            number_digit(&value, *p);
+            lastdigit = *p;
+        }
+        if (input_at(p))
+            break;
+    }
+
+    //  Recognize ordinals based on last digit of number
+    switch (lastdigit) {
+        case '1': //  ST
+            if (makeupper(T->ch) == 'S' && makeupper(ahead(1)) == 'T' &&
+                !isalpha(ahead(2)) && !isdigit(ahead(2))) {
+                say_number(&value, TRUE);
+                new_char(); //  Used ch
+                new_char(); //  Used the next
+                return;
+            }
+            break;
+
+        case '2': //  ND
+            if (makeupper(T->ch) == 'N' && makeupper(ahead(1)) == 'D' &&
+                !isalpha(ahead(2)) && !isdigit(ahead(2))) {
+                say_number(&value, TRUE);
+                new_char(); //  Used ch
+                new_char(); //  Used the next
+                return;
+            }
+            break;
+
+        case '3': //  RD
+            if (makeupper(T->ch) == 'R' && makeupper(ahead(1)) == 'D' &&
+                !isalpha(ahead(2)) && !isdigit(ahead(2))) {
+                say_number(&value, TRUE);
+                new_char(); //  Used ch
+                new_char(); //  Used the next
+                return;
+            }
+            break;
+
+        case '0': //  TH
+        case '4': //  TH
+        case '5': //  TH
+        case '6': //  TH
+        case '7': //  TH
+        case '8': //  TH
+        case '9': //  TH
+            if (makeupper(T->ch) == 'T' && makeupper(ahead(1)) == 'H' &&
+                !isalpha(ahead(2)) && !isdigit(ahead(2))) {
+                say_number(&value, TRUE);
+                new_char(); //  Used ch
+                new_char(); //  Used the next
+                return;
+            }
+            break;
+    }
+
+    say_number(&value, FALSE);
+
+    //  Recognize decimal points
+    if (T->ch == '.' && isdigit(ahead(1))) {
+        outspan(&Number_word_ops[NW_POINT]);
+        for (new_char(); isdigit(T->ch); new_char()) {
+            say_ascii(T->ch);
+        }
+    }
+
+    //  Spell out trailing abbreviations
+    if (isalpha(T->ch)) {
+        while (isalpha(T->ch)) {
+            say_ascii(T->ch);
+            new_char();
+        }
+    }
+
+    return;
+}
+
+void have_letter()
+{
+    char buff[MAX_LENGTH + 16]; //  fold_run() may write 16 past a word
+    int count, n, k;
+    char *p;
+
+    count = 0;
+    buff[count++] = ' '; //  Required initial blank
+
+    buff[count++] = makeupper(T->ch);
+
+    for (p = T->in_ptr + 1;; p = T->in_ptr) {
+        for (n = run_length(p, TK_LETTER); n > 0; n -= k, p += k) {
+            k = n < MAX_LENGTH - 1 - count ? n : MAX_LENGTH - 1 - count;
+            fold_run(&buff[count], p, k);
+            count += k;
+            if (count > MAX_LENGTH - 2) {
+                buff[count++] = ' ';
+                buff[count++] = '\0';
+                xlate_word(buff);
+                count = 1;
+            }
+        }
+        if (input_at(p))
+            break;
+    }
+
+    buff[count++] = ' '; //  Required terminating blank
+    buff[count++] = '\0';
+
+    //  Check for AAANNN type abbreviations
+    if (isdigit(T->ch)) {
+        spell_word(buff);
+        return;
+    } else //  [tomj] "A" and "I" are words!
+        if ((strlen(buff) == 3) && (strcmp(buff, " I ") != 0) &&
+            (strcmp(buff, " A ") != 0)) //  one character, two spaces
+        say_ascii(buff[1]);
+    else if (T->ch == '.') //  Possible abbreviation
+        abbrev(buff);
+    else
+        xlate_word(buff);
+
+    if (T->ch == '-' && isalpha(ahead(1)))
+        new_char(); //  Skip hyphens
+}
+
+//  Handle abbreviations.  Text in buff was followed by '.'
+void abbrev(buff) char buff[];
+{
+    if (strcmp(buff, " DR ") == 0) {
+        xlate_word(" DOCTOR ");
+        new_char();
+    } else if (strcmp(buff, " MR ") == 0) {
+        xlate_word(" MISTER ");
+        new_char();
+    } else if (strcmp(buff, " MRS ") == 0) {
+        xlate_word(" MISSUS ");
+        new_char();
+    } else if (strcmp(buff, " PHD ") == 0) {
+        spell_word(" PHD ");
+        new_char();
+    } else
+        xlate_word(buff);
+}
+
+//  !!! end of PARSE.C
+
+/*
+**    English to Phoneme translation.
+**
+**    Rules are made up of four parts:
+**
+**        The left context.
+**        The text to match.
+**        The right context.
+**        The phonemes to substitute for the matched text.
+**
+**    Procedure:
+**
+**        Seperate each block of letters (apostrophes included)
+**        and add a space on each side.  For each unmatched
+**        letter in the word, look through the rules where the
+**        text to match starts with the letter in the word.  If
+**        the text to match is found and the right and left
+**        context patterns also match, output the phonemes for
+**        that rule and skip to the next unmatched letter.
+**
+**
+**    Special Context Symbols:
+**
+**        #    One or more vowels
+**        :    Zero or more consonants
+**        ^    One consonant.
+**        .    One of B, D, V, G, J, L, M, N, R, W or Z (voiced
+**            consonants)
+**        %    One of ER, E, ES, ED, ING, ELY (a suffix)
+**            (Right context only)
+**        +    One of E, I or Y (a "front" vowel)
+*/
+
+int isvowel(char chr)
+{
+    return (chr == 'A' || chr == 'E' || chr == 'I' || chr == 'O' || chr == 'U');
+}
+
+int isconsonant(char chr)
+{
+    return (isupper(chr) && !isvowel(chr));
+}
+
+/*
+**    Word cache.
+**
+**    Announcement text uses few words over and over, so xlate_word() keeps
+**    the allophones of recent words and replays them on a hit without going
+**    near the rules.  All memory is allocated once by start_cache(): a
+**    slab of fixed size entries (the uppercased, blank padded word as the
+**    key, its allophones as the value) and an open addressing table of
+**    twice as many slots, probed linearly.  When the slab is full the CLOCK
+**    hand picks the next entry not used since it last passed.  Size it with
+**    -c; -f reports hits and misses.
+*/
+
+
+void start_cache(int entries)
+{
+    unsigned long slots;
+    char *p;
+
+    for (slots = 2; slots < 2UL * entries; slots <<= 1)
+        ;
+    p = malloc(slots * sizeof(int) + entries * (CACHE_KEY + CACHE_VALUE + 2 +
+               sizeof(short) + sizeof(unsigned long)));
+    if (p == 0) {
+        fputs("Error: Out of memory for word cache.\n", stderr);
+        exit(3);
+    }
+    T->cache_slot = (int *)p;
+    T->cache_hashes = (unsigned long *)(T->cache_slot + slots);
+    T->cache_vallen = (short *)(T->cache_hashes + entries);
+    T->cache_key = (char *)(T->cache_vallen + entries);
+    T->cache_value = (unsigned char *)(T->cache_key + (size_t)entries * CACHE_KEY);
+    T->cache_keylen = T->cache_value + (size_t)entries * CACHE_VALUE;
+    T->cache_ref = T->cache_keylen + entries;
+
+    memset(T->cache_slot, 0xff, slots * sizeof(int));
+    T->cache_mask = slots - 1;
+    T->cache_size = entries;
+    T->cache_used = 0;
+    T->cache_hand = 0;
+}
+
+//  Forget every word, as when the rules change.
+static void flush_cache()
+{
+    if (T->cache_size == 0)
+        return;
+    memset(T->cache_slot, 0xff, (T->cache_mask + 1) * sizeof(int));
+    T->cache_used = 0;
+    T->cache_hand = 0;
+}
+
+static unsigned long cache_hash(char *word, size_t len)
+{
+    unsigned long h = 2166136261UL; //  FNV-1a
+
+    while (len--)
+        h = ((h ^ (unsigned char)*word++) * 16777619UL) & 0xffffffffUL;
+    return h;
+}
+
+//  Speak a cached word; FALSE if it isn't there.
+static int cache_lookup(char *word, size_t len, unsigned long hash)
+{
+    unsigned long i;
+    int e;
+
+    for (i = hash & T->cache_mask; (e = T->cache_slot[i]) >= 0;
+         i = (i + 1) & T->cache_mask) {
+        if (T->cache_hashes[e] == hash && T->cache_keylen[e] == len &&
+            memcmp(&T->cache_key[(size_t)e * CACHE_KEY], word, len) == 0) {
+            T->cache_ref[e] = 1;
+            T->cache_hits++;
+            write_out(&T->cache_value[(size_t)e * CACHE_VALUE], T->cache_vallen[e]);
+            return TRUE;
+        }
+    }
+    T->cache_misses++;
+    return FALSE;
+}
+
+//  Take an entry's slot out of the table, closing the gap behind it.
+static void cache_unlink(int e)
+{
+    unsigned long i, j, k;
+
+    for (i = T->cache_hashes[e] & T->cache_mask; T->cache_slot[i] != e;
+         i = (i + 1) & T->cache_mask)
+        ;
+    for (j = i;;) {
+        j = (j + 1) & T->cache_mask;
+        if (T->cache_slot[j] < 0)
+            break;
+        k = T->cache_hashes[T->cache_slot[j]] & T->cache_mask;
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+            continue; //  still reachable from its home slot
+        T->cache_slot[i] = T->cache_slot[j];
+        i = j;
+    }
+    T->cache_slot[i] = -1;
+}
+
+//  Remember the allophones just captured for a word.
+static void cache_insert(char *word, size_t len, unsigned long hash)
+{
+    unsigned long i;
+    int e;
+
+    if (T->cache_used < T->cache_size) {
+        e = T->cache_used++;
+    } else {
+        for (;;) { //  CLOCK: skip recently used entries, clearing them
+            e = T->cache_hand;
+            T->cache_hand = (T->cache_hand + 1) % T->cache_size;
+            if (!T->cache_ref[e])
+                break;
+            T->cache_ref[e] = 0;
+        }
+        cache_unlink(e);
+    }
+
+    memcpy(&T->cache_key[(size_t)e * CACHE_KEY], word, len);
+    memcpy(&T->cache_value[(size_t)e * CACHE_VALUE], T->capture_buf, T->capture_len);
+    T->cache_keylen[e] = (unsigned char)len;
+    T->cache_vallen[e] = (short)T->capture_len;
+    T->cache_hashes[e] = hash;
+    T->cache_ref[e] = 0;
+
+    for (i = hash & T->cache_mask; T->cache_slot[i] >= 0;
+         i = (i + 1) & T->cache_mask)
+        ;
+    T->cache_slot[i] = e;
+}
+
+void report_cache()
+{
+    unsigned long total = T->cache_hits + T->cache_misses;
+
+    fprintf(stderr, "word cache: %d entries, %lu hits, %lu misses (%.1f%% hit)\n",
+            T->cache_size, T->cache_hits, T->cache_misses,
+            total ? 100.0 * T->cache_hits / total : 0.0);
+}
+
+/*
+**    Pronunciation lexicon.
+**
+**    Words the rules get wrong can be listed with their phonemes in a text
+**    file and compiled by lexgen (see lexgen.c and lexicon.h).  -l maps the
+**    compiled file read only and xlate_word() looks every word up in it
+**    before the rules: one hash, one probe, one compare.  Nothing is parsed
+**    or copied at startup beyond checking that the header adds up.
+*/
+
+static unsigned char *Lexicon; //  the mapped file
+static Lexhead *Lex_head;
+static unsigned int *Lex_disp;
+static Lexslot *Lex_slot;
+
+/* Map a whole file, or return 0.  A writable map is private: changes to
+it are copied on write and never reach the file. */
+static void *map_file(char *name, unsigned long *size, int writable)
+{
+    void *p;
+#ifdef _WIN32
+    HANDLE file, map;
+    DWORD high;
+
+    file = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL, 0);
+    if (file == INVALID_HANDLE_VALUE)
+        return 0;
+    *size = GetFileSize(file, &high);
+    map = CreateFileMappingA(file, 0, writable ? PAGE_WRITECOPY : PAGE_READONLY,
+                             0, 0, 0);
+    CloseHandle(file);
+    if (map == 0)
+        return 0;
+    p = MapViewOfFile(map, writable ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(map); //  the view keeps it
+    return p;
+#else
+    struct stat st;
+    int fd;
+
+    fd = open(name, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    *size = (unsigned long)st.st_size;
+    p = mmap(0, st.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+             writable ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+    close(fd); //  the mapping keeps it
+    return p == MAP_FAILED ? 0 : p;
+#endif
+}
+
+static void unmap_file(void *p, unsigned long size)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(p);
+#else
+    munmap(p, size);
+#endif
+}
+
+//  Milliseconds on a clock that only goes forwards, for timing.
+static double now_ms()
+{
+#ifdef _WIN32
+    LARGE_INTEGER t, f;
+
+    QueryPerformanceCounter(&t);
+    QueryPerformanceFrequency(&f);
+    return 1000.0 * t.QuadPart / f.QuadPart;
+#else
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return 1000.0 * t.tv_sec + t.tv_nsec / 1e6;
+#endif
+}
+
+void load_lexicon(char *name)
+{
+    unsigned long size;
+    unsigned char *p;
+    Lexhead *h;
+
+    p = map_file(name, &size, FALSE);
+    if (p == 0) {
+        fputs("Error: Cannot map lexicon file.\n", stderr);
+        exit(1);
+    }
+    h = (Lexhead *)p;
+    if (size < sizeof(Lexhead) || h->magic != LEX_MAGIC ||
+        h->version != LEX_VERSION || h->size != size || h->buckets == 0 ||
+        h->disp != sizeof(Lexhead) ||
+        h->slot != h->disp + h->buckets * sizeof(unsigned int) ||
+        h->text != h->slot + h->count * sizeof(Lexslot) || h->text > size) {
+        fputs("Error: Not a lexicon built by this lexgen.\n", stderr);
+        exit(1);
+    }
+    if (h->count == 0)
+        return; //  nothing to look up
+    Lexicon = p;
+    Lex_head = h;
+    Lex_disp = (unsigned int *)(p + h->disp);
+    Lex_slot = (Lexslot *)(p + h->slot);
+}
+
+//  Speak a word from the lexicon; FALSE if it isn't there.
+static int lex_word(char *word, size_t len)
+{
+    Lexslot *slot;
+    unsigned char *out;
+    unsigned int d;
+    int n;
+
+    if (len < 3) //  just the blanks
+        return FALSE;
+    word++; //  past the initial blank
+    len -= 2;
+
+    d = Lex_disp[lex_hash(0, word, (int)len) % Lex_head->buckets];
+    slot = &Lex_slot[lex_hash(d, word, (int)len) % Lex_head->count];
+    if (slot->word_len != len || slot->word > Lex_head->size - len ||
+        slot->out > Lex_head->size - slot->out_len ||
+        memcmp(Lexicon + slot->word, word, len) != 0)
+        return FALSE;
+
+    for (out = Lexicon + slot->out, n = slot->out_len; n--;)
+        outchar((Fast_speech ? Fast_map[*out++ & 0x3f] : *out++) + bias);
+    return TRUE;
+}
+
+/*
+**    Rule tracing.
+**
+**    Built with TRACE_RULES, tx2al can say why a word came out the way it
+**    did: with -e pattern, each word matching the pattern (* and ? wild,
+**    any case) leaves a record of every rule find_rule() tried, and what
+**    became of it, in a ring in memory (see trace.h), saved to tx2al.trc
+**    at exit for tracedump to print.  A word that isn't traced costs one
+**    test of tracing per rule; in other builds the TRACE macros are empty.
+*/
+
+#ifdef TRACE_RULES
+
+#define TRACE(kind, arg, rule)                  \
+    do {                                        \
+        if (T->tracing)                            \
+            trace_record(kind, arg, rule);      \
+    } while (0)
+#define TRACE_WORD(word)                        \
+    do {                                        \
+        if (Trace_pattern)                      \
+            trace_word(word);                   \
+    } while (0)
+#define TRACE_END() (T->tracing = FALSE)
+
+static Tracerec *trace_record(int kind, int arg, int rule)
+{
+    Tracerec *r;
+
+    r = &T->trace_ring[T->trace_written++ & (TRACE_RECORDS - 1)];
+    r->kind = (unsigned char)kind;
+    r->arg = (unsigned char)arg;
+    r->rule = (unsigned short)rule;
+    memset(r->text, 0, sizeof(r->text));
+    return r;
+}
+
+//  Does n characters of s fit the pattern?
+static int trace_match(const char *pat, const char *s, int n)
+{
+    for (; *pat != '\0'; pat++, s++, n--) {
+        if (*pat == '*') {
+            for (;; s++, n--) {
+                if (trace_match(pat + 1, s, n))
+                    return TRUE;
+                if (n == 0)
+                    return FALSE;
+            }
+        }
+        if (n == 0 || (*pat != '?' && *pat != *s))
+            return FALSE;
+    }
+    return n == 0;
+}
+
+//  Start tracing a word, blanks and all, if it is one -e asked for.
+static void trace_word(char *word)
+{
+    Tracerec *r;
+    char *w;
+    int len, n, i;
+
+    for (w = word; *w == ' '; w++)
+        ;
+    for (n = (int)strlen(w); n > 0 && w[n - 1] == ' '; n--)
+        ;
+    T->tracing = trace_match(Trace_pattern, w, n);
+    if (!T->tracing)
+        return;
+
+    len = (int)strlen(word);
+    if (len > 255)
+        len = 255;
+    for (i = 0; i < len; i += 4) {
+        r = trace_record(i ? TR_TEXT : TR_WORD, len, 0);
+        memcpy(r->text, word + i, len - i < 4 ? len - i : 4);
+    }
+}
+
+void start_trace()
+{
+    char *p;
+
+    for (p = Trace_pattern; *p; p++)
+        *p = (char)toupper((unsigned char)*p);
+}
+
+void write_trace()
+{
+    FILE *file;
+    Tracehead h;
+
+    file = fopen(TRACE_FILE, "wb");
+    if (file == 0) {
+        fputs("Error: Cannot create " TRACE_FILE ".\n", stderr);
+        exit(2);
+    }
+    h.magic = TRACE_MAGIC;
+    h.version = TRACE_VERSION;
+    h.records = TRACE_RECORDS;
+    h.written_lo = (unsigned int)T->trace_written;
+    h.written_hi = (unsigned int)(T->trace_written >> 32);
+    fwrite(&h, sizeof(h), 1, file);
+    fwrite(T->trace_ring, sizeof(Tracerec), TRACE_RECORDS, file);
+    fclose(file);
+}
+#else
+#define TRACE(kind, arg, rule)
+#define TRACE_WORD(word)
+#define TRACE_END()
+
+void start_trace()
+{
+    fputs("Warning: -e needs a build with TRACE_RULES, not tracing.\n", stderr);
+    Trace_pattern = 0;
+}
+
+void write_trace()
+{
+}
+#endif
+
+void xlate_word(word) char word[];
+{
+    int was = T->stage;
+
+    T->stage = ST_RULES;
+    T->st_words++;
+    TRACE_WORD(word);
+    speak_word(word);
+    TRACE_END();
+    T->stage = was;
+}
+
+static void speak_word(char *word)
+{
+    Wordinfo info;
+    int index; //  Current position in word
+    int type;  //  First letter of match part
+    char *key = word; //  the word as passed, for the cache
+    unsigned long hash = 0;
+    size_t len;
+
+    len = strlen(key);
+    if (Lexicon && lex_word(key, len)) {
+        TRACE(TR_LEXICON, 0, 0);
+        find_rule(key, (int)len - 1, Rules[0]); //  the blank after it
+        return;
+    }
+
+    //  Known word: replay its allophones
+    if (T->cache_size && len < CACHE_KEY && !T->tracing) {
+        hash = cache_hash(key, len);
+        if (cache_lookup(key, len, hash))
+            return;
+        T->capturing = TRUE;
+        T->capture_len = 0;
+    }
+
+    word_info(&info, word); //  padded copy plus context index
+    word = info.word;
+    T->cur_word = &info;
+    if (Use_ac)
+        ac_scan(word); //  candidate rules for every position
+
+    index = 1; //  Skip the initial blank
+    do {
+        if (isupper(word[index]))
+            type = word[index] - 'A' + 1;
+        else
+            type = 0;
+
+        index = find_rule(word, index, Rules[type]);
+    } while (word[index] != '\0');
+
+    T->cur_word = 0;
+    word_done(&info);
+
+    if (T->capturing) {
+        T->capturing = FALSE;
+        if (T->capture_len <= CACHE_VALUE)
+            cache_insert(key, len, hash);
+    }
+}
+
+/*
+**    Match-string index.
+**
+**    Each rule table gets a trie over its match strings, built once at
+**    startup by build_rule_index().  Every node carries the list of rules
+**    whose match string is a prefix of the path to that node, kept in
+**    table order.  Walking word[index...] down to the deepest node thus
+**    yields exactly the rules whose match text fits at that position, in
+**    the original priority order, so the first rule that passes its
+**    context checks is the same one the linear scan would have found.
+*/
+
+typedef struct _trie {
+    char ch;      //  character leading into this node
+    int child;    //  first child node, 0 if none
+    int sibling;  //  next node under the same parent, 0 if none
+    int ncands;   //  number of candidate rules at this node
+    int cands;    //  cands[] offset of the packed rule numbers
+} Trie;
+
+/*
+**    Rule packs.
+**
+**    The rules find_rule() interprets are a rule pack (see packrules.c and
+**    rulepack.h): english.c packed at startup by build_rule_index(), or a
+**    file made by packgen and mapped by load_rule_pack().  A Rulepack holds
+**    the pointers into one and the trie over its match strings; any number
+**    may be open at once, and each context's pack is the one it uses.
+**    Their outputs get the bias and the fast speech stand-ins when they
+**    are opened, so the arrays are the same in both.
+*/
+
+struct _rulepack {
+    Packhead *head;                    //  the pack itself
+    int count;                         //  rules in all tables
+    int first[NUM_RULESETS + 1];
+    unsigned char *mlen, *llen, *rlen, *olen;
+    unsigned short *match, *left, *right, *out;
+    unsigned short *lcode, *rcode;     //  code[] offsets, 0 = none
+
+    /* Rule signatures, checked by find_rule() before running any context
+    program: the class (a CC_ bit) or exact byte the character just
+    before the match must have, and the same for the character just after
+    it.  Zero means no requirement.  They are taken from the first op of
+    each context program.  open_pack() folds them into one mask and value
+    per rule, for the class and byte before the match in the low half of a
+    word and the class and byte after it in the high half. */
+    unsigned char *lclass, *rclass, *lbyte, *rbyte;
+    unsigned long *sig_mask, *sig_value;
+    char *text;
+    unsigned char *code;               //  context programs
+
+    Trie *nodes;                       //  match-string index
+    int nodes_used, nodes_size;
+    int root[NUM_RULESETS];
+    short *cands; //  all nodes' candidate lists, back to back
+
+    struct _rulepack *retired_next;    //  see reclaim_packs()
+    unsigned long retired_epoch;
+    double retired_ms;
+};
+
+static Rulepack Builtin_pack; //  english.c
+
+static unsigned char Char_class[256];
+
+/* Prefilter counters, reported with -f */
+
+//  Compare a short literal run, a machine word at a time.
+static int lit_equal(const char *text, const unsigned char *lit, int n)
+{
+    unsigned int a, b;
+    unsigned short c, d;
+
+    for (; n >= 4; n -= 4, text += 4, lit += 4) {
+        memcpy(&a, text, 4);
+        memcpy(&b, lit, 4);
+        if (a != b)
+            return FALSE;
+    }
+    if (n >= 2) {
+        memcpy(&c, text, 2);
+        memcpy(&d, lit, 2);
+        if (c != d)
+            return FALSE;
+        text += 2;
+        lit += 2;
+        n -= 2;
+    }
+    return n == 0 || *text == (char)*lit;
+}
+
+/* Build the context index for a word: copy it into the middle of a padded
+buffer (context matching may read a few bytes either side of the word)
+and precompute each position's class and vowel/consonant run extents. */
+static void word_info(Wordinfo *wi, char *word)
+{
+    size_t len, span, p;
+    unsigned char c;
+
+    len = strlen(word) + 1;
+    span = CONTEXT_PAD + len + CONTEXT_PAD;
+    wi->heap = 0;
+    if (span <= WORD_SPAN) {
+        wi->text = wi->text_buf;
+        wi->cls = wi->cls_buf;
+        wi->vowels_left = wi->run_buf;
+    } else {
+        wi->heap = malloc(span * (1 + 1 + 4 * sizeof(unsigned short)));
+        if (wi->heap == 0) {
+            fputs("Error: Out of memory.\n", stderr);
+            exit(3);
+        }
+        wi->vowels_left = (unsigned short *)wi->heap;
+        wi->text = (char *)(wi->vowels_left + 4 * span);
+        wi->cls = (unsigned char *)(wi->text + span);
+    }
+    wi->vowels_right = wi->vowels_left + span;
+    wi->cons_left = wi->vowels_right + span;
+    wi->cons_right = wi->cons_left + span;
+
+    memset(wi->text, ' ', CONTEXT_PAD);
+    memcpy(wi->text + CONTEXT_PAD, word, len);
+    memset(wi->text + CONTEXT_PAD + len, '\0', CONTEXT_PAD);
+    wi->word = wi->text + CONTEXT_PAD;
+
+    for (p = 0; p < span; p++) {
+        c = Char_class[(unsigned char)wi->text[p]];
+        wi->cls[p] = c;
+        wi->vowels_left[p] = (c & CC_VOWEL) ? (p ? wi->vowels_left[p - 1] : 0) + 1 : 0;
+        wi->cons_left[p] = (c & CC_CONSONANT) ? (p ? wi->cons_left[p - 1] : 0) + 1 : 0;
+    }
+    for (p = span; p-- > 0;) {
+        c = wi->cls[p];
+        wi->vowels_right[p] =
+            (c & CC_VOWEL) ? (p + 1 < span ? wi->vowels_right[p + 1] : 0) + 1 : 0;
+        wi->cons_right[p] =
+            (c & CC_CONSONANT) ? (p + 1 < span ? wi->cons_right[p + 1] : 0) + 1 : 0;
+    }
+}
+
+static void word_done(Wordinfo *wi)
+{
+    if (wi->heap)
+        free(wi->heap);
+}
+
+//  Run a left context program from position p, the character before the match.
+static int run_left(const unsigned char *code, Wordinfo *wi, int p)
+{
+    int n;
+
+    T->st_left++;
+    for (;;) {
+        switch (*code++) {
+            case CTX_END:
+                return TRUE;
+            case CTX_LIT:
+                n = *code++;
+                if (!lit_equal(wi->text + p - n + 1, code, n))
+                    return FALSE;
+                p -= n;
+                code += n;
+                break;
+            case CTX_VOWELS:
+                if (wi->vowels_left[p] == 0)
+                    return FALSE;
+                p -= wi->vowels_left[p];
+                break;
+            case CTX_CONS0:
+                p -= wi->cons_left[p];
+                break;
+            case CTX_CONS1:
+                if (!(wi->cls[p--] & CC_CONSONANT))
+                    return FALSE;
+                break;
+            case CTX_VOICED:
+                if (!(wi->cls[p--] & CC_VOICED))
+                    return FALSE;
+                break;
+            case CTX_FRONT:
+                if (!(wi->cls[p--] & CC_FRONT))
+                    return FALSE;
+                break;
+            default:
+                return FALSE;
+        }
+    }
+}
+
+//  Run a right context program from position p, the character after the match.
+static int run_right(const unsigned char *code, Wordinfo *wi, int p)
+{
+    const char *text;
+    int n;
+
+    T->st_right++;
+    for (;;) {
+        switch (*code++) {
+            case CTX_END:
+                return TRUE;
+            case CTX_LIT:
+                n = *code++;
+                if (!lit_equal(wi->text + p, code, n))
+                    return FALSE;
+                p += n;
+                code += n;
+                break;
+            case CTX_VOWELS:
+                if (wi->vowels_right[p] == 0)
+                    return FALSE;
+                p += wi->vowels_right[p];
+                break;
+            case CTX_CONS0:
+                p += wi->cons_right[p];
+                break;
+            case CTX_CONS1:
+                if (!(wi->cls[p++] & CC_CONSONANT))
+                    return FALSE;
+                break;
+            case CTX_VOICED:
+                if (!(wi->cls[p++] & CC_VOICED))
+                    return FALSE;
+                break;
+            case CTX_FRONT:
+                if (!(wi->cls[p++] & CC_FRONT))
+                    return FALSE;
+                break;
+            case CTX_SUFFIX: //  ER, E, ES, ED, ING, ELY
+                text = wi->text + p;
+                if (text[0] == 'E') {
+                    if (text[1] == 'L' && text[2] == 'Y')
+                        p += 3;
+                    else if (text[1] == 'R' || text[1] == 'S' || text[1] == 'D')
+                        p += 2;
+                    else
+                        p++;
+                } else if (text[0] == 'I' && text[1] == 'N' && text[2] == 'G')
+                    p += 3;
+                else
+                    return FALSE;
+                break;
+            default:
+                return FALSE;
+        }
+    }
+}
+
+static int trie_node(Rulepack *pk, char ch)
+{
+    Trie *t;
+
+    if (pk->nodes_used == pk->nodes_size) {
+        pk->nodes_size = pk->nodes_size ? pk->nodes_size * 2 : 1024;
+        pk->nodes = realloc(pk->nodes, pk->nodes_size * sizeof(Trie));
+        if (pk->nodes == 0) {
+            fputs("Error: Out of memory building rule index.\n", stderr);
+            exit(3);
+        }
+    }
+    t = &pk->nodes[pk->nodes_used];
+    t->ch = ch;
+    t->child = 0;
+    t->sibling = 0;
+    t->ncands = 0;
+    t->cands = 0;
+    return pk->nodes_used++;
+}
+
+static int trie_step(Trie *nodes, int node, char ch)
+{
+    int n;
+
+    for (n = nodes[node].child; n != 0; n = nodes[n].sibling) {
+        if (nodes[n].ch == ch)
+            return n;
+    }
+    return 0;
+}
+
+//  Walk (and if need be grow) the trie along a match string.
+static int trie_insert(Rulepack *pk, int node, char *match)
+{
+    int n;
+
+    for (; *match != '\0'; match++) {
+        n = trie_step(pk->nodes, node, *match);
+        if (n == 0) {
+            n = trie_node(pk, *match);
+            pk->nodes[n].sibling = pk->nodes[node].child;
+            pk->nodes[node].child = n;
+        }
+        node = n;
+    }
+    return node;
+}
+
+//  Add a rule to a node and everything below it; -1 just counts.
+static void trie_spread(Rulepack *pk, int node, int id)
+{
+    Trie *t = &pk->nodes[node];
+    int n;
+
+    if (id >= 0)
+        pk->cands[t->cands + t->ncands] = (short)id;
+    t->ncands++;
+    for (n = t->child; n != 0; n = pk->nodes[n].sibling)
+        trie_spread(pk, n, id);
+}
+
+static void index_pack(Rulepack *pk)
+{
+    int type, id, n, total;
+
+    trie_node(pk, '\0'); //  node 0 is reserved as "no node"
+
+    for (type = 0; type < NUM_RULESETS; type++) {
+        pk->root[type] = trie_node(pk, '\0');
+        for (id = pk->first[type]; id < pk->first[type + 1]; id++)
+            trie_insert(pk, pk->root[type], &pk->text[pk->match[id]]);
+    }
+
+    //  Size the candidate lists, then fill them in table order
+    for (type = 0; type < NUM_RULESETS; type++) {
+        for (id = pk->first[type]; id < pk->first[type + 1]; id++)
+            trie_spread(pk, trie_insert(pk, pk->root[type], &pk->text[pk->match[id]]), -1);
+    }
+    for (total = 0, n = 1; n < pk->nodes_used; n++) {
+        pk->nodes[n].cands = total;
+        total += pk->nodes[n].ncands;
+        pk->nodes[n].ncands = 0;
+    }
+    pk->cands = malloc((total + 1) * sizeof(short));
+    if (pk->cands == 0) {
+        fputs("Error: Out of memory building rule index.\n", stderr);
+        exit(3);
+    }
+    for (type = 0; type < NUM_RULESETS; type++) {
+        for (id = pk->first[type]; id < pk->first[type + 1]; id++)
+            trie_spread(pk, trie_insert(pk, pk->root[type], &pk->text[pk->match[id]]), id);
+    }
+}
+
+/* Point a Rulepack at a pack in memory, which must be writable unless
+there is no bias or fast speech to apply, and index it. */
+static void open_pack(Rulepack *pk, unsigned char *image)
+{
+    Packhead *h = (Packhead *)image;
+    char *s;
+    int i, n;
+
+    pk->head = h;
+    pk->count = h->count;
+    for (i = 0; i <= NUM_RULESETS; i++)
+        pk->first[i] = h->first[i];
+    pk->match = (unsigned short *)(image + h->shorts);
+    pk->left = pk->match + pk->count;
+    pk->right = pk->left + pk->count;
+    pk->out = pk->right + pk->count;
+    pk->lcode = pk->out + pk->count;
+    pk->rcode = pk->lcode + pk->count;
+    pk->mlen = image + h->bytes;
+    pk->llen = pk->mlen + pk->count;
+    pk->rlen = pk->llen + pk->count;
+    pk->olen = pk->rlen + pk->count;
+    pk->lclass = pk->olen + pk->count;
+    pk->rclass = pk->lclass + pk->count;
+    pk->lbyte = pk->rclass + pk->count;
+    pk->rbyte = pk->lbyte + pk->count;
+    pk->text = (char *)(image + h->text);
+    pk->code = image + h->code;
+
+    //  Signatures as one compare (the classes are single CC_ bits)
+    pk->sig_mask = malloc(2 * pk->count * sizeof(unsigned long));
+    if (pk->sig_mask == 0) {
+        fputs("Error: Out of memory.\n", stderr);
+        exit(3);
+    }
+    pk->sig_value = pk->sig_mask + pk->count;
+    for (i = 0; i < pk->count; i++) {
+        pk->sig_mask[i] = (pk->lclass[i] | (pk->lbyte[i] ? 0xff00UL : 0)) |
+                          (pk->rclass[i] | (pk->rbyte[i] ? 0xff00UL : 0)) << 16;
+        pk->sig_value[i] = (pk->lclass[i] | (unsigned long)pk->lbyte[i] << 8) |
+                           (pk->rclass[i] | (unsigned long)pk->rbyte[i] << 8) << 16;
+    }
+
+    if (bias || Fast_speech) {
+        for (i = 0; i < pk->count; i++) {
+            n = speakable((unsigned char *)&pk->text[pk->out[i]], pk->olen[i]);
+            pk->olen[i] = (unsigned char)n;
+        }
+    }
+
+    //  Character classes for the context programs
+    if (Char_class[' '] == 0) {
+        for (i = 'A'; i <= 'Z'; i++)
+            Char_class[i] = isvowel((char)i) ? CC_VOWEL : CC_CONSONANT;
+        for (s = "BDVGJLMNRWZ"; *s; s++)
+            Char_class[(unsigned char)*s] |= CC_VOICED;
+        for (s = "EIY"; *s; s++)
+            Char_class[(unsigned char)*s] |= CC_FRONT;
+        Char_class[' '] = CC_BLANK;
+    }
+
+    index_pack(pk);
+}
+
+//  Pack and index english.c, the rules in use unless -u says otherwise.
+void build_rule_index()
+{
+    unsigned long size;
+
+    if (Builtin_pack.head == 0)
+        open_pack(&Builtin_pack, pack_rules(&size));
+}
+
+//  Whether a string of len bytes at off, and its NUL, are inside text.
+static int in_text(char *text, unsigned long ntext, unsigned int off, unsigned int len)
+{
+    return off + len < ntext && text[off + len] == '\0';
+}
+
+/* Whether the context program at off ends inside code, and walks no
+further from the match than the padding word_info() leaves (CONTEXT_PAD
+either side). */
+static int good_context(unsigned char *code, unsigned long ncode, unsigned int off)
+{
+    int reach, n;
+
+    for (reach = 0; off < ncode && reach <= CONTEXT_PAD;) {
+        switch (code[off++]) {
+            case CTX_END:
+                return TRUE;
+            case CTX_LIT:
+                n = off < ncode ? code[off] : CTX_RUN + 1;
+                if (n > CTX_RUN)
+                    return FALSE;
+                off += 1 + n;
+                reach += n;
+                break;
+            case CTX_VOWELS: //  runs stop at the padding
+            case CTX_CONS0:
+                break;
+            case CTX_SUFFIX:
+                reach += 3;
+                break;
+            default: //  one character, or CTX_FAIL
+                reach++;
+                break;
+        }
+    }
+    return FALSE;
+}
+
+/* Whether every rule's strings and context programs are inside the pack,
+so a damaged file is refused rather than read out of bounds.  The header
+has been checked. */
+static int pack_in_bounds(unsigned char *p)
+{
+    Packhead *h = (Packhead *)p;
+    unsigned short *match, *left, *right, *out, *lcode, *rcode;
+    unsigned char *mlen, *llen, *rlen, *olen, *code;
+    unsigned long ntext, ncode;
+    unsigned int i;
+    char *text;
+
+    match = (unsigned short *)(p + h->shorts);
+    left = match + h->count;
+    right = left + h->count;
+    out = right + h->count;
+    lcode = out + h->count;
+    rcode = lcode + h->count;
+    mlen = p + h->bytes;
+    llen = mlen + h->count;
+    rlen = llen + h->count;
+    olen = rlen + h->count;
+    text = (char *)(p + h->text);
+    ntext = h->code - h->text;
+    code = p + h->code;
+    ncode = h->phonemes - h->code;
+
+    for (i = 0; i < h->count; i++) {
+        if (mlen[i] == 0 || !in_text(text, ntext, match[i], mlen[i]) ||
+            !in_text(text, ntext, left[i], llen[i]) ||
+            !in_text(text, ntext, right[i], rlen[i]) ||
+            (unsigned long)out[i] + olen[i] >= ntext ||
+            !good_context(code, ncode, lcode[i]) ||
+            !good_context(code, ncode, rcode[i]))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/* Map a pack written by packgen and get it ready to use.  It is mapped
+copy on write: pages the bias or fast speech change become private, the
+rest stay shared with every other process using the same file.  Returns
+0, having said why, if the file isn't a pack this tx2al can use. */
+Rulepack *load_rule_pack(char *name)
+{
+    unsigned long size;
+    unsigned char *p;
+    Packhead *h;
+    Packphoneme *ph;
+    Rulepack *pk;
+    char phoneme[3];
+    unsigned int i;
+
+    p = map_file(name, &size, TRUE);
+    if (p == 0) {
+        fputs("Error: Cannot map rule pack.\n", stderr);
+        return 0;
+    }
+    h = (Packhead *)p;
+    if (size < sizeof(Packhead) || h->magic != PACK_MAGIC ||
+        h->version != PACK_VERSION || h->size != size ||
+        h->count > size / 20 || h->nphonemes > size / sizeof(Packphoneme) ||
+        h->first[0] != 0 || h->first[NUM_RULESETS] != h->count ||
+        h->shorts != sizeof(Packhead) ||
+        h->bytes != h->shorts + h->count * 6 * sizeof(unsigned short) ||
+        h->text != h->bytes + h->count * 8 || h->code <= h->text ||
+        h->phonemes <= h->code ||
+        h->size != h->phonemes + h->nphonemes * sizeof(Packphoneme)) {
+        fputs("Error: Not a rule pack built by this packgen.\n", stderr);
+        unmap_file(p, size);
+        return 0;
+    }
+    for (i = 1; i <= NUM_RULESETS; i++) {
+        if (h->first[i] < h->first[i - 1]) {
+            fputs("Error: Not a rule pack built by this packgen.\n", stderr);
+            unmap_file(p, size);
+            return 0;
+        }
+    }
+    if (!pack_in_bounds(p)) {
+        fputs("Error: Rule pack is damaged.\n", stderr);
+        unmap_file(p, size);
+        return 0;
+    }
+
+    //  Its opcodes are only right if it was resolved with this p2a
+    ph = (Packphoneme *)(p + h->phonemes);
+    for (i = 0; i < h->nphonemes; i++, ph++) {
+        phoneme[0] = ph->name[0];
+        phoneme[1] = ph->name[1];
+        phoneme[2] = '\0';
+        if (allophone(phoneme) != ph->op) {
+            fputs("Error: Rule pack was built with a different allophone table.\n",
+                  stderr);
+            unmap_file(p, size);
+            return 0;
+        }
+    }
+
+    pk = calloc(1, sizeof(Rulepack));
+    if (pk == 0) {
+        fputs("Error: Out of memory.\n", stderr);
+        exit(3);
+    }
+    open_pack(pk, p);
+    return pk;
+}
+
+//  Unmap a pack from load_rule_pack() and free its index.
+static void close_rule_pack(Rulepack *pk)
+{
+    unmap_file(pk->head, pk->head->size);
+    free(pk->nodes);
+    free(pk->cands);
+    free(pk->sig_mask);
+    free(pk);
+}
+
+/*
+**    Rule reload.
+**
+**    A pack given with -u is loaded again when its file changes (looked at
+**    once a second) or when t2a_reload() asks, as tx2al does on SIGHUP,
+**    without stopping translation and without a lock on the way through
+**    the rules.  Live_pack is the published pack.  Each token xlate_file()
+**    translates is a read section: enter_rules() notes the reload epoch in
+**    the reader's slot and takes Live_pack as its pack, leave_rules()
+**    clears the slot.  reload_rules() loads the new pack off to the side,
+**    publishes it with one pointer store and starts a new epoch; sections
+**    already under way finish on the pack they took, and the old one is
+**    freed by the last of them to leave, once no slot holds an epoch from
+**    before the swap.  One thread reloads or frees at a time, whichever
+**    context noticed first; each context has a slot, claimed by t2a_new().
+**    Every reload reports how long loading and the swap took, and how long
+**    the old pack lingered.
+*/
+
+#ifdef _WIN32
+#define FULL_FENCE() MemoryBarrier()
+#define CLAIM(flag) (InterlockedCompareExchange((flag), 1, 0) == 0)
+#else
+#define FULL_FENCE() __sync_synchronize()
+#define CLAIM(flag) __sync_bool_compare_and_swap((flag), 0, 1)
+#endif
+
+#define MAX_READERS 64
+
+static Rulepack *volatile Live_pack = &Builtin_pack;
+static volatile unsigned long Epoch = 1;
+static volatile unsigned long Reader_epoch[MAX_READERS]; //  0 when not reading
+static volatile long Reader_used[MAX_READERS];           //  slot has a context
+static volatile long Reloading;         //  a context reloads or frees packs
+static Rulepack *Retired;               //  swapped out, not freed yet
+static volatile long Retired_count;     //  how many, read without the lock
+static volatile sig_atomic_t Reload_pending;
+static time_t Watch_time;               //  last look at the file
+static struct stat Watch_stat;          //  what it looked like
+
+static void enter_rules()
+{
+    Rulepack *pk;
+
+    Reader_epoch[T->reader] = Epoch;
+    FULL_FENCE(); //  announced before Live_pack is read
+    pk = Live_pack;
+    if (pk != T->pack) {
+        T->pack = pk;
+        flush_cache(); //  its words came from the old rules
+    }
+}
+
+//  Free the retired packs no reader can still be using.
+static void reclaim_packs()
+{
+    Rulepack **link, *pk;
+    unsigned long oldest, e;
+    int i;
+
+    oldest = 0;
+    for (i = 0; i < MAX_READERS; i++) {
+        e = Reader_epoch[i];
+        if (e != 0 && (oldest == 0 || e < oldest))
+            oldest = e;
+    }
+    for (link = &Retired; (pk = *link) != 0;) {
+        if (oldest != 0 && oldest < pk->retired_epoch) {
+            link = &pk->retired_next;
+            continue;
+        }
+        *link = pk->retired_next;
+        Retired_count--;
+        fprintf(stderr, "reload: old rules freed %.3f ms after the swap\n",
+                now_ms() - pk->retired_ms);
+        close_rule_pack(pk);
+    }
+}
+
+//  Free retired packs now, unless another context holds the reload lock.
+static void try_reclaim()
+{
+    if (Retired_count == 0 || !CLAIM(&Reloading))
+        return;
+    reclaim_packs();
+    FULL_FENCE();
+    Reloading = 0;
+}
+
+static void leave_rules()
+{
+    FULL_FENCE(); //  done with the pack before saying so
+    Reader_epoch[T->reader] = 0;
+    try_reclaim(); //  this may have been the last reader of one
+}
+
+/* Load a pack and make it the one new translations use.  If it won't
+load, the rules in use stay.  Returns TRUE if it was swapped in. */
+int reload_rules(char *name)
+{
+    Rulepack *pk, *old;
+    double start, loaded, swapped;
+
+    start = now_ms();
+    pk = load_rule_pack(name);
+    if (pk == 0) {
+        fprintf(stderr, "reload: %s not loaded, rules unchanged\n", name);
+        return FALSE;
+    }
+    loaded = now_ms();
+
+    old = Live_pack;
+    FULL_FENCE(); //  pack complete before it is published
+    Live_pack = pk;
+    FULL_FENCE();
+    Epoch = Epoch + 1; //  readers from here on see pk
+    FULL_FENCE();
+    swapped = now_ms();
+
+    fprintf(stderr, "reload: %s, %d rules, load %.3f ms, swap %.3f ms\n", name,
+            pk->count, loaded - start, swapped - loaded);
+    if (old != &Builtin_pack) {
+        old->retired_epoch = Epoch;
+        old->retired_ms = swapped;
+        old->retired_next = Retired;
+        Retired = old;
+        Retired_count++;
+    }
+    reclaim_packs();
+    return TRUE;
+}
+
+//  Reload the -u pack if asked to or if the file has changed.
+static void check_reload()
+{
+    struct stat st;
+    time_t t;
+
+    if (!Reload_pending && time(0) == Watch_time)
+        return;
+    if (!CLAIM(&Reloading))
+        return; //  another context is seeing to it
+    t = time(0);
+    if (Reload_pending || (t != Watch_time && stat(Pack_file, &st) == 0 &&
+                           (st.st_mtime != Watch_stat.st_mtime ||
+                            st.st_size != Watch_stat.st_size))) {
+        Reload_pending = FALSE;
+        stat(Pack_file, &Watch_stat); //  a bad file is tried again when it changes
+        reload_rules(Pack_file);
+    } else if (Retired) {
+        reclaim_packs(); //  in case a reader left while this was held
+    }
+    Watch_time = t;
+    FULL_FENCE();
+    Reloading = 0;
+}
+
+//  Translate with pk's rules from now on, and so do contexts made after.
+void use_rule_pack(Rulepack *pk)
+{
+    if (T)
+        T->pack = pk;
+    Live_pack = pk;
+}
+
+//  Translate with the rules in a pack file, reloaded when it changes (-u).
+void use_rule_file(char *name)
+{
+    Pack_file = name;
+}
+
+//  Watch the -u pack for changes.
+void watch_rule_pack()
+{
+    stat(Pack_file, &Watch_stat);
+    Watch_time = time(0);
+}
+
+//  Reload the -u pack before the next token.  Only sets a flag, so a
+//  signal handler may call it.
+void t2a_reload()
+{
+    Reload_pending = TRUE;
+}
+
+#if !defined(T2A_LIBRARY) && defined(SIGHUP)
+//  tx2al reloads on SIGHUP; a program using the library says when itself.
+static void on_hangup(int sig)
+{
+    t2a_reload();
+    signal(sig, on_hangup);
+}
+#endif
+
+/*
+**    Library.
+**
+**    t2a_init() makes what every context shares, once: the rule pack and
+**    its indexes, the token classes and the tables resolve_outputs() fills
+**    in.  A program using tx2al as a library (see tx2al.h) calls it after
+**    the settings it wants and before any thread makes a context, main()
+**    after the options; nothing guards it, so t2a_new() only checks that
+**    it has run.  Each context gets its own word cache and, when the rules
+**    can be reloaded, a reader slot.  t2a_file() translates a whole file
+**    with one, t2a_feed() and t2a_finish() text as it comes (see above).
+*/
+
+static int Ready; //  t2a_init() has run
+
+void t2a_init()
+{
+    Rulepack *pk;
+
+    if (Ready)
+        return;
+    if (Pack_file) { //  after -s, which changes what it says
+        pk = load_rule_pack(Pack_file);
+        if (pk == 0)
+            exit(1);
+        use_rule_pack(pk);
+        if (!Profile_file)
+            watch_rule_pack(); //  the profile is of these rules
+        Use_generated = FALSE; //  rules_gen.c is english.c
+    } else {
+        if (Use_generated)
+            check_generated_rules();
+        build_rule_index(); //  index the rule tables once
+    }
+    resolve_outputs(); //  and the other phoneme tables
+    report_unknown_phonemes();
+    if (Use_vector)
+        build_vector_match();
+    if (Use_ac)
+        build_rule_automaton();
+    start_tokens();
+    Ready = TRUE;
+}
+
+//  A context translating to out, and this thread's from now on.
+t2a_context *t2a_new(Sink *out)
+{
+    t2a_context *t;
+    int i;
+
+    if (!Ready) {
+        fputs("Error: t2a_init() has to come before t2a_new().\n", stderr);
+        exit(1);
+    }
+    t = calloc(1, sizeof(t2a_context));
+    if (t == 0) {
+        fputs("Error: Out of memory.\n", stderr);
+        exit(3);
+    }
+    t->out = out;
+    t->pack = Live_pack;
+    T = t;
+    if (Pack_file && !Profile_file) { //  it reloads, see enter_rules()
+        for (i = 0; i < MAX_READERS && !CLAIM(&Reader_used[i]); i++)
+            ;
+        if (i == MAX_READERS) {
+            fputs("Error: Too many contexts.\n", stderr);
+            exit(3);
+        }
+        t->reader = i;
+    }
+    if (Profile_file)
+        start_profile(); //  every word through the rules, no cache
+    else if (Cache_entries > 0)
+        start_cache(Cache_entries);
+#ifdef TRACE_RULES
+    if (Trace_pattern) {
+        t->trace_ring = calloc(TRACE_RECORDS, sizeof(Tracerec));
+        if (t->trace_ring == 0) {
+            fputs("Error: Out of memory.\n", stderr);
+            exit(3);
+        }
+    }
+#endif
+    return t;
+}
+
+//  Translate all of in and flush it out.
+void t2a_file(t2a_context *t, FILE *in)
+{
+    T = t;
+    t->in_file = in;
+    t->started = FALSE;
+    xlate_file();
+    t->stage = ST_OUTPUT;
+    if (Peephole)
+        peephole_end();
+    sink_flush(t->out);
+#ifndef _WIN32
+    if (t->in_map) {
+        munmap(t->in_map, t->in_mapped);
+        t->in_map = 0;
+    }
+#endif
+}
 
-int isvowel(char chr)
+void t2a_free(t2a_context *t)
 {
-    return (chr == 'A' || chr == 'E' || chr == 'I' || chr == 'O' || chr == 'U');
+    if (Pack_file && !Profile_file) {
+        FULL_FENCE();
+        Reader_used[t->reader] = 0;
+        try_reclaim();
+    }
+    if (T == t)
+        T = 0;
+    free(t->in_buf);
+    free(t->held);
+    free(t->cache_slot); //  the whole cache, see start_cache()
+    free(t->ac_found);
+    free(t->ac_nfound);
+    free(t->prof_tried);
+    free(t->trace_ring);
+    free(t);
 }
 
-int isconsonant(char chr)
+//  Which of Rules[] a table is, or -1.
+static int rule_type(Rule *rules)
 {
-    return (isupper(chr) && !isvowel(chr));
+    int type;
+
+    for (type = 0; type < NUM_RULESETS; type++) {
+        if (Rules[type] == rules)
+            return type;
+    }
+    return -1;
 }
 
-void xlate_word(word) char word[];
+//  Deepest trie node reached by the text at word[index] for this table.
+static int rule_candidates(char word[], int index, int type)
 {
-    int index; //  Current position in word
-    int type;  //  First letter of match part
+    int node, n;
 
-    index = 1; //  Skip the initial blank
-    do {
-        if (isupper(word[index]))
-            type = word[index] - 'A' + 1;
-        else
-            type = 0;
+    if (type < 0)
+        return 0;
 
-        index = find_rule(word, index, Rules[type]);
-    } while (word[index] != '\0');
+    node = T->pack->root[type];
+    while ((n = trie_step(T->pack->nodes, node, word[index])) != 0) {
+        node = n;
+        index++;
+    }
+    return node;
 }
 
-int find_rule(word, index, rules) char word[];
-int index;
-Rule *rules;
+/*
+**    Compiled rules.
+**
+**    When built with GENERATED_RULES, rules_gen.c (written by rulegen from
+**    english.c) supplies one straight-line matcher per rule table and
+**    find_rule() calls it instead of interpreting the table.  The
+**    interpreter below stays as the fallback: it is used if the generated
+**    tables don't line up with english.c, or when -R asks for it.
+*/
+
+#ifdef GENERATED_RULES
+#include "rules_gen.c"
+
+void check_generated_rules()
+{
+    if (Gen_hash != rules_hash())
+        Use_generated = FALSE;
+    if (!Use_generated)
+        fputs("Warning: rules_gen.c is out of date, using rule interpreter.\n",
+              stderr);
+}
+#else
+void check_generated_rules()
 {
-    Rule *rule;
-    char *left, *match, *right, *output;
-    int remainder;
+}
+#endif
 
-    for (;;) //  Search for the rule
-    {
-        rule = rules++;
-        match = (*rule)[1];
+void report_filter()
+{
+    fprintf(stderr, "prefilter: %lu candidates, %lu rejected by signature (%.1f%%), "
+                    "%lu by context\n",
+            T->sig_tried, T->sig_rejected,
+            T->sig_tried ? 100.0 * T->sig_rejected / T->sig_tried : 0.0,
+            T->ctx_rejected);
+}
 
-        if (match == 0) //  bad symbol!
-        {
-            fprintf(stderr, "Error: Can't find rule for: '%c' in \"%s\"\n",
-                    word[index], word);
-            return index + 1; //  Skip it!
-        }
+/*
+**    Statistics.
+**
+**    --stats writes a summary to stderr at the end, as "stats:" lines of
+**    name=value pairs for scripts to pick apart.  The counters are kept
+**    all the time, an increment each.  For time per stage the code notes
+**    which stage it is in (the context's stage, one store where work changes hands:
+**    fill_input(), xlate_word(), the number speakers and write_out()) and,
+**    with --stats, a CPU time and a wall clock interval timer sample it
+**    every millisecond; each stage gets the share of the total its
+**    samples say.  Without interval timers only the totals are given.
+*/
 
-        for (remainder = index; *match != '\0'; match++, remainder++) {
-            if (*match != word[remainder])
-                break;
-        }
+#ifndef T2A_LIBRARY
+static const char *Stage_name[ST_COUNT] = {
+    "startup", "input", "tokenize", "rules", "numbers", "output"};
+static double St_wall, St_cpu; //  at start_stats()
 
-        if (*match != '\0') //  found missmatch
-            continue;
-        /*
-    printf("\nWord: \"%s\", Index:%4d, Trying: \"%s/%s/%s\" = \"%s\"\n",
-        word, index, (*rule)[0], (*rule)[1], (*rule)[2], (*rule)[3]);
-    */
-        left = (*rule)[0];
-        right = (*rule)[2];
-
-        if (!leftmatch(left, &word[index - 1]))
-            continue;
-        /*
-    printf("leftmatch(\"%s\",\"...%c\") succeded!\n", left, word[index-1]);
-    */
-        if (!rightmatch(right, &word[remainder]))
-            continue;
-        /*
-    printf("rightmatch(\"%s\",\"%s\") succeded!\n", right, &word[remainder]);
-    */
-        output = (*rule)[3];
-        /*
-    printf("Success: ");
-    */
-        outstring(output);
-        return remainder;
+#ifdef ITIMER_PROF
+static volatile unsigned long Cpu_samples[ST_COUNT], Wall_samples[ST_COUNT];
+
+//  The stage of the context running, see main()
+#define STAGE() (T ? T->stage : ST_STARTUP)
+
+static void on_prof(int sig)
+{
+    (void)sig;
+    Cpu_samples[STAGE()]++;
+}
+
+static void on_alarm(int sig)
+{
+    (void)sig;
+    Wall_samples[STAGE()]++;
+}
+
+static void sample_stages(int on)
+{
+    struct sigaction sa;
+    struct itimerval every;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_flags = SA_RESTART; //  don't cut reads short
+    sigemptyset(&sa.sa_mask);
+    every.it_interval.tv_sec = 0;
+    every.it_interval.tv_usec = on ? 1000 : 0;
+    every.it_value = every.it_interval;
+    if (on) {
+        sa.sa_handler = on_prof;
+        sigaction(SIGPROF, &sa, 0);
+        sa.sa_handler = on_alarm;
+        sigaction(SIGALRM, &sa, 0);
     }
+    setitimer(ITIMER_PROF, &every, 0);
+    setitimer(ITIMER_REAL, &every, 0);
 }
+#endif
 
-int leftmatch(
-    pattern,
-    context) char *pattern; //  first char of pattern to match in text
-char *context;              //  last char of text to be matched
+//  CPU time used by the process so far.
+static double cpu_ms()
 {
-    char *pat;
-    char *text;
-    int count;
+#ifdef _WIN32
+    FILETIME created, ended, kernel, user;
+
+    GetProcessTimes(GetCurrentProcess(), &created, &ended, &kernel, &user);
+    return ((double)kernel.dwLowDateTime + user.dwLowDateTime +
+            4294967296.0 * ((double)kernel.dwHighDateTime + user.dwHighDateTime)) /
+           10000.0;
+#else
+    return 1000.0 * clock() / CLOCKS_PER_SEC;
+#endif
+}
 
-    if (*pattern == '\0') //  null string matches any context
-    {
-        return TRUE;
+static void start_stats()
+{
+    St_wall = now_ms();
+    St_cpu = cpu_ms();
+#ifdef ITIMER_PROF
+    sample_stages(TRUE);
+#endif
+}
+
+static void report_stats()
+{
+    double wall, cpu, cpu_all, wall_all;
+    int s;
+
+    wall = now_ms() - St_wall;
+    cpu = cpu_ms() - St_cpu;
+    fprintf(stderr,
+            "stats: chars=%lu words=%lu numbers=%lu punct_groups=%lu "
+            "find_rule=%lu candidates=%lu left_ctx=%lu right_ctx=%lu "
+            "unknown_phoneme=%lu no_rule=%lu allophones=%lu\n",
+            T->st_chars, T->st_words, T->st_numbers, T->st_punct, T->st_find_rule,
+            T->sig_tried, T->st_left, T->st_right, Unknown_phonemes,
+            T->st_no_rule, T->out_count);
+#ifdef ITIMER_PROF
+    sample_stages(FALSE);
+    cpu_all = wall_all = 0;
+    for (s = 0; s < ST_COUNT; s++) {
+        cpu_all += Cpu_samples[s];
+        wall_all += Wall_samples[s];
+    }
+    for (s = 0; s < ST_COUNT; s++) {
+        fprintf(stderr, "stats: stage=%s wall_ms=%.3f cpu_ms=%.3f samples=%lu\n",
+                Stage_name[s], wall_all ? wall * Wall_samples[s] / wall_all : 0.0,
+                cpu_all ? cpu * Cpu_samples[s] / cpu_all : 0.0, Cpu_samples[s]);
     }
+#endif
+    fprintf(stderr, "stats: total wall_ms=%.3f cpu_ms=%.3f\n", wall, cpu);
+}
+#endif
 
-    //  point to last character in pattern string
-    count = (int)strlen(pattern);
-    pat = pattern + (count - 1);
+/*
+**    Vector match.
+**
+**    With -v, find_rule() finds the rules whose match text fits by testing
+**    a whole table at once instead of walking the trie.  Every match string
+**    (none is longer than 8 characters) is kept as an 8 byte pattern with
+**    an 8 byte mask in Mv_pat/Mv_mask, in packed rule order.  The 8 bytes
+**    at word[index] are loaded once, and each step masks them and compares
+**    against two (SSE2) or four (AVX2) patterns, giving a bitmask of the
+**    rules that fit.  That is walked lowest bit first, i.e. in table order,
+**    through try_rule(), so the chosen rule is the same as the trie path's.
+**    Without SSE2 the same test runs one rule at a time on 64 bit words.
+*/
 
-    text = context;
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MV_LANES 4
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MV_LANES 2
+#else
+#define MV_LANES 1
+#endif
+
+static unsigned long long *Mv_pat;     //  match string, zero padded
+static unsigned long long *Mv_mask;    //  0xff for each byte of it
+static int Mv_count;                   //  rounded up to whole vectors
+static Rulepack *Mv_pack;              //  the rules they are for
+
+void build_vector_match()
+{
+    Rulepack *pk = Live_pack; //  the rules contexts start on
+    int id, i;
+    unsigned char *pat, *mask;
+
+    Mv_pack = pk;
+    Mv_count = (pk->count + MV_LANES - 1) / MV_LANES * MV_LANES;
+    Mv_pat = calloc(2 * Mv_count, sizeof(unsigned long long));
+    if (Mv_pat == 0) {
+        fputs("Error: Out of memory building rule index.\n", stderr);
+        exit(3);
+    }
+    Mv_mask = Mv_pat + Mv_count;
 
-    for (; count > 0; pat--, count--) {
-        //  First check for simple text or space
-        if (isalpha(*pat) || *pat == '\'' || *pat == ' ') {
-            if (*pat != *text) {
-                return FALSE;
-            } else {
-                text--;
-                continue;
-            }
+    for (id = 0; id < pk->count; id++) {
+        if (pk->mlen[id] > 8) {
+            fprintf(stderr, "Error: Match string too long for -v: \"%s\"\n",
+                    &pk->text[pk->match[id]]);
+            exit(3);
         }
+        pat = (unsigned char *)&Mv_pat[id];
+        mask = (unsigned char *)&Mv_mask[id];
+        for (i = 0; i < pk->mlen[id]; i++) {
+            pat[i] = (unsigned char)pk->text[pk->match[id] + i];
+            mask[i] = 0xff;
+        }
+    }
+}
 
-        switch (*pat) {
-            case '#': //  One or more vowels
-                if (!isvowel(*text))
-                    return FALSE;
-
-                text--;
+//  Index of the lowest set bit
+static int lowest_bit(unsigned long long bits)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(bits);
+#else
+    int n;
+
+    for (n = 0; !(bits & 1); n++)
+        bits >>= 1;
+    return n;
+#endif
+}
 
-                while (isvowel(*text))
-                    text--;
-                break;
+//  Bitmask of the rules first..first+63 (and < last) that fit at text.
+static unsigned long long vector_fits(const char *text, int first, int last)
+{
+    unsigned long long bits, word;
+    int id;
+#if MV_LANES > 1
+    int m;
+#endif
+#if MV_LANES == 4
+    __m256i w, p, k;
+#elif MV_LANES == 2
+    __m128i w, p, k;
+#endif
+
+    memcpy(&word, text, 8);
+    bits = 0;
+    id = first / MV_LANES * MV_LANES; //  vectors start on a lane boundary
+#if MV_LANES == 4
+    w = _mm256_set1_epi64x((long long)word);
+#elif MV_LANES == 2
+    w = _mm_loadl_epi64((const __m128i *)&word);
+    w = _mm_unpacklo_epi64(w, w);
+#endif
+    for (; id < last && id < first + 64; id += MV_LANES) {
+#if MV_LANES == 4
+        p = _mm256_loadu_si256((const __m256i *)&Mv_pat[id]);
+        k = _mm256_loadu_si256((const __m256i *)&Mv_mask[id]);
+        m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(w, k), p));
+#elif MV_LANES == 2
+        p = _mm_loadu_si128((const __m128i *)&Mv_pat[id]);
+        k = _mm_loadu_si128((const __m128i *)&Mv_mask[id]);
+        m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(w, k), p));
+#endif
+#if MV_LANES > 1
+        {
+            int lane;
 
-            case ':': //  Zero or more consonants
-                while (isconsonant(*text))
-                    text--;
-                break;
+            for (lane = 0; lane < MV_LANES; lane++) {
+                if (((m >> (8 * lane)) & 0xff) == 0xff && id + lane >= first &&
+                    id + lane < first + 64)
+                    bits |= 1ULL << (id + lane - first);
+            }
+        }
+#else
+        if ((word & Mv_mask[id]) == Mv_pat[id])
+            bits |= 1ULL << (id - first);
+#endif
+    }
+    if (last - first < 64)
+        bits &= (1ULL << (last - first)) - 1;
+    return bits;
+}
 
-            case '^': //  One consonant
-                if (!isconsonant(*text))
-                    return FALSE;
-                text--;
-                break;
+//  First rule of a table that fits and applies at position base, or -1.
+static int vector_rule(Wordinfo *wi, int base, int type)
+{
+    unsigned long long bits;
+    int first, last, id;
+
+    last = T->pack->first[type + 1];
+    for (first = T->pack->first[type]; first < last; first += 64) {
+        for (bits = vector_fits(wi->text + base, first, last); bits != 0;
+             bits &= bits - 1) {
+            id = first + lowest_bit(bits);
+            if (try_rule(id, wi, base))
+                return id;
+        }
+    }
+    return -1;
+}
 
-            case '.': //  B, D, V, G, J, L, M, N, R, W, Z
-                if (*text != 'B' && *text != 'D' && *text != 'V' && *text != 'G' &&
-                    *text != 'J' && *text != 'L' && *text != 'M' && *text != 'N' &&
-                    *text != 'R' && *text != 'W' && *text != 'Z')
-                    return FALSE;
-                text--;
-                break;
+/*
+**    Aho-Corasick candidates.
+**
+**    With -a, xlate_word() makes one left to right pass over the word with
+**    an Aho-Corasick automaton built over every match string in english.c,
+**    and records, for each position, which match strings start there
+**    (at most one per length).  find_rule() then takes its candidates from
+**    that record instead of walking the rule index again at every letter:
+**    the rules of the current table using those strings, in table order.
+*/
 
-            case '+': // E, I or Y (front vowel)
-                if (*text != 'E' && *text != 'I' && *text != 'Y')
-                    return FALSE;
-                text--;
-                break;
+#define AC_MAXLEN 8 //  longest match string
+
+static int Ac_nodes, Ac_size;   //  automaton states in use / allocated
+static int Ac_syms;             //  input symbols, 0 being "no pattern has it"
+static unsigned char Ac_sym[256];
+static int *Ac_next;            //  [state * Ac_syms + sym] -> state
+static int *Ac_fail;            //  longest proper suffix state
+static int *Ac_out;             //  pattern ending here, or -1
+static int *Ac_link;            //  next suffix state with a pattern, or 0
+static int Ac_npats;
+static unsigned char *Ac_plen;  //  per pattern: length,
+static int *Ac_prules, *Ac_pcount; //  and its rules in Ac_rules[]
+static short *Ac_rules;
+static Rulepack *Ac_pack;       //  the rules it is for
+
+/* Per word record, in the context: ac_found[p * AC_MAXLEN + n] for
+n < ac_nfound[p] are the patterns starting at position p of the word (not
+the padded text). */
+
+static void *ac_alloc(void *old, size_t size)
+{
+    void *p;
 
-            case '%':
-            default:
-                fprintf(stderr, "Bad char in left rule: '%c'\n", *pat);
-                return FALSE;
-        }
+    p = realloc(old, size);
+    if (p == 0) {
+        fputs("Error: Out of memory building rule automaton.\n", stderr);
+        exit(3);
     }
+    return p;
+}
 
-    return TRUE;
+static int ac_state()
+{
+    int i;
+
+    if (Ac_nodes == Ac_size) {
+        Ac_size = Ac_size ? Ac_size * 2 : 1024;
+        Ac_next = ac_alloc(Ac_next, (size_t)Ac_size * Ac_syms * sizeof(int));
+        Ac_fail = ac_alloc(Ac_fail, Ac_size * sizeof(int));
+        Ac_out = ac_alloc(Ac_out, Ac_size * sizeof(int));
+        Ac_link = ac_alloc(Ac_link, Ac_size * sizeof(int));
+    }
+    for (i = 0; i < Ac_syms; i++)
+        Ac_next[Ac_nodes * Ac_syms + i] = -1;
+    Ac_fail[Ac_nodes] = 0;
+    Ac_out[Ac_nodes] = -1;
+    Ac_link[Ac_nodes] = 0;
+    return Ac_nodes++;
 }
 
-int rightmatch(
-    pattern,
-    context) char *pattern; //  first char of pattern to match in text
-char *context;              //  last char of text to be matched
+void build_rule_automaton()
 {
-    char *pat;
-    char *text;
+    Rulepack *pk = Live_pack; //  the rules contexts start on
+    int id, i, node, sym, head, tail, *queue, f, n, total;
+    unsigned char *m;
+
+    //  Alphabet: the characters used in match strings
+    Ac_pack = pk;
+    Ac_syms = 1;
+    for (id = 0; id < pk->count; id++) {
+        if (pk->mlen[id] > AC_MAXLEN) {
+            fprintf(stderr, "Error: Match string too long for -a: \"%s\"\n",
+                    &pk->text[pk->match[id]]);
+            exit(3);
+        }
+        for (m = (unsigned char *)&pk->text[pk->match[id]]; *m; m++) {
+            if (Ac_sym[*m] == 0)
+                Ac_sym[*m] = (unsigned char)Ac_syms++;
+        }
+    }
 
-    if (*pattern == '\0') //  null string matches any context
-        return TRUE;
+    //  The trie, one pattern per distinct match string
+    ac_state();
+    Ac_plen = ac_alloc(0, pk->count);
+    Ac_pcount = ac_alloc(0, pk->count * sizeof(int));
+    Ac_prules = ac_alloc(0, pk->count * sizeof(int));
+    for (id = 0; id < pk->count; id++) {
+        node = 0;
+        for (m = (unsigned char *)&pk->text[pk->match[id]]; *m; m++) {
+            sym = Ac_sym[*m];
+            if (Ac_next[node * Ac_syms + sym] < 0) {
+                n = ac_state();
+                Ac_next[node * Ac_syms + sym] = n;
+            }
+            node = Ac_next[node * Ac_syms + sym];
+        }
+        if (Ac_out[node] < 0) {
+            Ac_out[node] = Ac_npats;
+            Ac_plen[Ac_npats] = pk->mlen[id];
+            Ac_pcount[Ac_npats++] = 0;
+        }
+        Ac_pcount[Ac_out[node]]++;
+    }
 
-    pat = pattern;
-    text = context;
+    //  Each pattern's rules, in packed (table) order
+    for (total = 0, i = 0; i < Ac_npats; i++) {
+        Ac_prules[i] = total;
+        total += Ac_pcount[i];
+        Ac_pcount[i] = 0;
+    }
+    Ac_rules = ac_alloc(0, (total + 1) * sizeof(short));
+    for (id = 0; id < pk->count; id++) {
+        node = 0;
+        for (m = (unsigned char *)&pk->text[pk->match[id]]; *m; m++)
+            node = Ac_next[node * Ac_syms + Ac_sym[*m]];
+        i = Ac_out[node];
+        Ac_rules[Ac_prules[i] + Ac_pcount[i]++] = id;
+    }
 
-    for (pat = pattern; *pat != '\0'; pat++) {
-        //  First check for simple text or space
-        if (isalpha(*pat) || *pat == '\'' || *pat == ' ') {
-            if (*pat != *text) {
-                return FALSE;
+    //  Failure and output links, breadth first; missing edges become
+    //  transitions so the pass over a word is one lookup per character.
+    queue = ac_alloc(0, Ac_nodes * sizeof(int));
+    head = tail = 0;
+    for (sym = 0; sym < Ac_syms; sym++) {
+        n = Ac_next[sym];
+        if (n < 0) {
+            Ac_next[sym] = 0;
+        } else {
+            Ac_fail[n] = 0;
+            queue[tail++] = n;
+        }
+    }
+    while (head < tail) {
+        node = queue[head++];
+        f = Ac_fail[node];
+        Ac_link[node] = Ac_out[f] >= 0 ? f : Ac_link[f];
+        for (sym = 0; sym < Ac_syms; sym++) {
+            n = Ac_next[node * Ac_syms + sym];
+            if (n < 0) {
+                Ac_next[node * Ac_syms + sym] = Ac_next[f * Ac_syms + sym];
             } else {
-                text++;
-                continue;
+                Ac_fail[n] = Ac_next[f * Ac_syms + sym];
+                queue[tail++] = n;
             }
         }
+    }
+    free(queue);
+}
 
-        switch (*pat) {
-            case '#': //  One or more vowels
-                if (!isvowel(*text))
-                    return FALSE;
+//  The single pass: record the patterns starting at each position of word.
+static void ac_scan(char *word)
+{
+    int len, p, state, n;
+
+    if (Ac_pack != T->pack)
+        return; //  find_rule() won't ask, the automaton is another pack's
+    len = (int)strlen(word);
+    if (len > T->ac_room) {
+        T->ac_room = len + MAX_LENGTH;
+        T->ac_found = ac_alloc(T->ac_found,
+                               (size_t)T->ac_room * AC_MAXLEN * sizeof(short));
+        T->ac_nfound = ac_alloc(T->ac_nfound, T->ac_room);
+    }
+    memset(T->ac_nfound, 0, len);
 
-                text++;
+    state = 0;
+    for (p = 0; p < len; p++) {
+        state = Ac_next[state * Ac_syms + Ac_sym[(unsigned char)word[p]]];
+        for (n = Ac_out[state] >= 0 ? state : Ac_link[state]; n != 0; n = Ac_link[n]) {
+            int start = p - Ac_plen[Ac_out[n]] + 1;
 
-                while (isvowel(*text))
-                    text++;
-                break;
+            T->ac_found[start * AC_MAXLEN + T->ac_nfound[start]++] =
+                (short)Ac_out[n];
+        }
+    }
+}
 
-            case ':': //  Zero or more consonants
-                while (isconsonant(*text))
-                    text++;
-                break;
+//  First rule of a table that starts at word[index] and applies, or -1.
+static int ac_rule(Wordinfo *wi, int base, int index, int type)
+{
+    short cands[AC_MAXLEN * 64], *r;
+    int n, i, j, k, count, first, last, id;
 
-            case '^': //  One consonant
-                if (!isconsonant(*text))
-                    return FALSE;
-                text++;
-                break;
+    first = T->pack->first[type];
+    last = T->pack->first[type + 1];
+    count = 0;
+    for (n = 0; n < T->ac_nfound[index]; n++) {
+        i = T->ac_found[index * AC_MAXLEN + n];
+        r = &Ac_rules[Ac_prules[i]];
+        for (j = 0; j < Ac_pcount[i] && count < AC_MAXLEN * 64; j++) {
+            id = r[j];
+            if (id < first || id >= last)
+                continue;
+            for (k = count++; k > 0 && cands[k - 1] > id; k--) //  keep in order
+                cands[k] = cands[k - 1];
+            cands[k] = (short)id;
+        }
+    }
+    for (i = 0; i < count; i++) {
+        if (try_rule(cands[i], wi, base))
+            return cands[i];
+    }
+    return -1;
+}
 
-            case '.': //  B, D, V, G, J, L, M, N, R, W, Z
-                if (*text != 'B' && *text != 'D' && *text != 'V' && *text != 'G' &&
-                    *text != 'J' && *text != 'L' && *text != 'M' && *text != 'N' &&
-                    *text != 'R' && *text != 'W' && *text != 'Z')
-                    return FALSE;
-                text++;
-                break;
+/*
+**    Rule profile.
+**
+**    With -p, try_rule() counts how often each rule was a candidate (its
+**    match text fitted) and how often it fired.  write_profile() saves the
+**    counts for ruleopt, which reorders english.c hottest rule first.
+**    The format is one line per rule: table, position in table, attempts,
+**    hits, and the match string for reference.
+*/
 
-            case '+': //  E, I or Y (front vowel)
-                if (*text != 'E' && *text != 'I' && *text != 'Y')
-                    return FALSE;
-                text++;
-                break;
 
-            case '%': //  ER, E, ES, ED, ING, ELY (a suffix)
-                if (*text == 'E') {
-                    text++;
-                    if (*text == 'L') {
-                        text++;
-                        if (*text == 'Y') {
-                            text++;
-                            break;
-                        } else {
-                            text--; //  Don't gobble L
-                            break;
-                        }
-                    } else if (*text == 'R' || *text == 'S' || *text == 'D')
-                        text++;
-                    break;
-                } else if (*text == 'I') {
-                    text++;
-                    if (*text == 'N') {
-                        text++;
-                        if (*text == 'G') {
-                            text++;
-                            break;
-                        }
-                    }
-                    return FALSE;
-                } else
-                    return FALSE;
+void start_profile()
+{
+    T->prof_tried = calloc(2 * T->pack->count + 1, sizeof(unsigned long));
+    if (T->prof_tried == 0) {
+        fputs("Error: Out of memory.\n", stderr);
+        exit(3);
+    }
+    T->prof_hits = T->prof_tried + T->pack->count;
+}
 
-            default:
-                fprintf(stderr, "Bad char in right rule:'%c'\n", *pat);
-                return FALSE;
+void write_profile(FILE *file)
+{
+    int type, id;
+
+    fprintf(file, "# tx2al rule profile: table rule attempts hits match\n");
+    for (type = 0; type < NUM_RULESETS; type++) {
+        for (id = T->pack->first[type]; id < T->pack->first[type + 1]; id++) {
+            fprintf(file, "%d %d %lu %lu \"%s\"\n", type, id - T->pack->first[type],
+                    T->prof_tried[id], T->prof_hits[id],
+                    &T->pack->text[T->pack->match[id]]);
         }
     }
+    fclose(file);
+}
+
+//  Speak rule id's output, resolved when its pack was opened
+void outrule(id) int id;
+{
+    if (T->pack->olen[id] != 0)
+        outbytes((unsigned char *)&T->pack->text[T->pack->out[id]],
+                 T->pack->olen[id]);
+}
 
+/* Try one candidate rule whose match text is known to fit at word[index]:
+check its signature and contexts and, if it applies, speak it.  Returns
+TRUE if the rule fired. */
+static int try_rule(int id, Wordinfo *wi, int base)
+{
+    Rulepack *pk = T->pack;
+    unsigned long key;
+    int end;
+
+    if (T->prof_tried)
+        T->prof_tried[id]++;
+
+    //  Signature: the characters either side of the match
+    T->sig_tried++;
+    end = base + pk->mlen[id];
+    key = wi->cls[base - 1] | (unsigned long)(unsigned char)wi->text[base - 1] << 8 |
+          (unsigned long)wi->cls[end] << 16 | (unsigned long)(unsigned char)wi->text[end] << 24;
+    if ((key & pk->sig_mask[id]) != pk->sig_value[id]) {
+        T->sig_rejected++;
+        TRACE(TR_SIGNATURE, base - (int)(wi->word - wi->text), id);
+        return FALSE;
+    }
+    if (pk->lcode[id] != 0 &&
+        !run_left(&pk->code[pk->lcode[id]], wi, base - 1)) {
+        T->ctx_rejected++;
+        TRACE(TR_LEFT, base - (int)(wi->word - wi->text), id);
+        return FALSE;
+    }
+    if (pk->rcode[id] != 0 &&
+        !run_right(&pk->code[pk->rcode[id]], wi, base + pk->mlen[id])) {
+        T->ctx_rejected++;
+        TRACE(TR_RIGHT, base - (int)(wi->word - wi->text), id);
+        return FALSE;
+    }
+    TRACE(TR_FIRED, base - (int)(wi->word - wi->text), id);
+    if (T->prof_hits)
+        T->prof_hits[id]++;
+    outrule(id);
     return TRUE;
 }
 
+int find_rule(word, index, rules) char word[];
+int index;
+Rule *rules;
+{
+    Wordinfo local, *wi;
+    short *cand;
+    int id, remainder, node, count, type, base;
+
+    T->st_find_rule++;
+    type = rule_type(rules);
+
+#ifdef GENERATED_RULES
+    if (Use_generated && type >= 0 && T->pack == &Builtin_pack) {
+        remainder = Gen_rules[type](word, index);
+        if (remainder != 0)
+            return remainder;
+        T->st_no_rule++;
+        fprintf(stderr, "Error: Can't find rule for: '%c' in \"%s\"\n",
+                word[index], word);
+        return index + 1; //  Skip it!
+    }
+#endif
+
+    //  Context index: xlate_word() has one, a lone call builds its own
+    wi = T->cur_word;
+    if (wi == 0 || wi->word != word) {
+        wi = &local;
+        word_info(wi, word);
+    }
+    base = (int)(wi->word - wi->text) + index;
+
+    remainder = index + 1; //  Skip it, if nothing fits
+    id = -1;
+    if (Use_ac && wi == T->cur_word && type >= 0 && Ac_pack == T->pack) {
+        id = ac_rule(wi, base, index, type);
+    } else if (Use_vector && type >= 0 && Mv_pack == T->pack) {
+        id = vector_rule(wi, base, type);
+    } else {
+        node = rule_candidates(word, index, type);
+        cand = &T->pack->cands[T->pack->nodes[node].cands];
+        for (count = T->pack->nodes[node].ncands; count > 0; cand++, count--) {
+            if (try_rule(*cand, wi, base)) {
+                id = *cand;
+                break;
+            }
+        }
+    }
+
+    if (id >= 0)
+        remainder = index + T->pack->mlen[id];
+    else { //  bad symbol!
+        T->st_no_rule++;
+        TRACE(TR_NO_RULE, index, 0);
+        fprintf(stderr, "Error: Can't find rule for: '%c' in \"%s\"\n",
+                word[index], word);
+    }
+
+    if (wi == &local)
+        word_done(wi);
+    return remainder;
+}
+
 //  !!!! End of PHONEME.C
 
 /*
@@ -971,11 +3962,19 @@ char *context;              //  last char of text to be matched
 **
 ** Synopsis:
 **
-**      say_cardinal(value)
-**          long int     value;          -- The number to output
+**      say_number(num, ordinal)
+**          Number       *num;           -- The digits to output
+**          int          ordinal;        -- TRUE for "first", not "one"
 **
 **    The number is translated into a string of phonemes
 **
+**    have_number() and have_dollars() don't go through a binary value at
+**    all: they collect the digits in a Number and say_number() reads it
+**    out three digits at a time, so a digit run can be any length.  Up to
+**    MAX_DIGITS digits are named with the scale words (quintillions and
+**    below); anything longer, serial numbers and the like, is read out in
+**    groups of three as it arrives.  Every 0..999 chunk, cardinal and
+**    ordinal, is resolved to opcodes once by resolve_outputs().
 */
 
 static char *Cardinals[] = {
@@ -998,152 +3997,195 @@ static char *Ord_twenties[] = {
     "twEHntIYEHTH ", "THERtIYEHTH ", "fOWrtIYEHTH ", "fIHftIYEHTH ",
     "sIHkstIYEHTH ", "sEHvEHntIYEHTH ", "EYtIYEHTH ", "nAYntIYEHTH "};
 
-/*
-** Translate a number to phonemes.  This version is for CARDINAL numbers.
-**     Note: this is recursive.
-*/
-void say_cardinal(value) long int value;
-{
-    if (value < 0) {
-        outstring("mAYnAHs ");
-        value = (-value);
-        if (value < 0) //  Overflow!  -32768
-        {
-            outstring("IHnfIHnIHtIY ");
-            return;
-        }
-    }
+#define COUNT(table) ((int)(sizeof(table) / sizeof(table[0])))
 
-    if (value >= 1000000000L) //  Billions
-    {
-        say_cardinal(value / 1000000000L);
-        outstring("bIHlIYAXn ");
-        value = value % 1000000000;
-        if (value == 0)
-            return;      //  Even billion
-        if (value < 100) //  as in THREE BILLION AND FIVE
-            outstring("AEnd ");
-    }
+//  The same as opcodes, filled in by resolve_outputs()
+static Span Cardinal_ops[COUNT(Cardinals)], Twenty_ops[COUNT(Twenties)];
+static Span Ordinal_ops[COUNT(Ordinals)], Ord_twenty_ops[COUNT(Ord_twenties)];
 
-    if (value >= 1000000L) //  Millions
-    {
-        say_cardinal(value / 1000000L);
-        outstring("mIHlIYAXn ");
-        value = value % 1000000L;
-        if (value == 0)
-            return;      //  Even million
-        if (value < 100) //  as in THREE MILLION AND FIVE
-            outstring("AEnd ");
-    }
+//  Scale words, by group: group 1 is thousands, 2 millions ...
+static char *Scales[] = {"", "THAWzAEnd ", "mIHlIYAXn ", "bIHlIYAXn ",
+                         "trIHlIYAXn ", "kwAAdrIHlIYAXn ", "kwIHntIHlIYAXn "};
 
-    //  Thousands 1000..1099 2000..99999
-    //  1100 to 1999 is eleven-hunderd to ninteen-hunderd
-    if ((value >= 1000L && value <= 1099L) || value >= 2000L) {
-        say_cardinal(value / 1000L);
-        outstring("THAWzAEnd ");
-        value = value % 1000L;
-        if (value == 0)
-            return;      //  Even thousand
-        if (value < 100) //  as in THREE THOUSAND AND FIVE
-            outstring("AEnd ");
-    }
+static char *Ord_scales[] = {"", "THAWzAEndTH ", "mIHlIYAXnTH ", "bIHlIYAXnTH ",
+                             "trIHlIYAXnTH ", "kwAAdrIHlIYAXnTH ",
+                             "kwIHntIHlIYAXnTH "};
 
-    if (value >= 100L) {
-        outstring(Cardinals[value / 100]);
-        outstring("hAHndrEHd ");
-        value = value % 100;
-        if (value == 0)
-            return; //  Even hundred
-    }
+//  By NW_ index
 
-    if (value >= 20) {
-        outstring(Twenties[(value - 20) / 10]);
-        value = value % 10;
-        if (value == 0)
-            return; //  Even ten
-    }
+static char *Number_words[NW_COUNT] = {
+    "hAHndrEHd ", "hAHndrEHdTH ", "AEnd ",   "pOYnt ", "dAAlER ",
+    "dAAlAArz ",  "AAnd ",        "sEHnt ",  "sEHnts ", "P3 "};
 
-    outstring(Cardinals[value]);
-    return;
-}
 
-/*
-** Translate a number to phonemes.  This version is for ORDINAL numbers.
-**     Note: this is recursive.
-*/
-void say_ordinal(value) long int value;
+static Span Scale_ops[COUNT(Scales)], Ord_scale_ops[COUNT(Ord_scales)];
+static Span Chunk_ops[1000], Ord_chunk_ops[1000]; //  0..999 in full
+
+/* Build the opcodes for n, 0..999, into op (when op isn't null), the
+way the old recursive say_cardinal() and say_ordinal() said it.  Returns
+the length.  Called only by resolve_outputs(), for the chunk tables. */
+static int build_chunk(int n, int ordinal, unsigned char *op)
 {
-    if (value < 0) {
-        outstring("mAHnAXs ");
-        value = (-value);
-        if (value < 0) //  Overflow!  -32768
-        {
-            outstring("IHnfIHnIHtIY ");
-            return;
-        }
+    Span *part[4];
+    int parts, len, i, r;
+
+    parts = 0;
+    r = n % 100;
+    if (n >= 100) {
+        part[parts++] = &Cardinal_ops[n / 100];
+        if (r == 0) //  Even hundred
+            part[parts++] = &Number_word_ops[ordinal ? NW_HUNDREDTH : NW_HUNDRED];
+        else
+            part[parts++] = &Number_word_ops[NW_HUNDRED];
+    }
+    if (r >= 20) {
+        if (ordinal && r % 10 == 0)
+            part[parts++] = &Ord_twenty_ops[(r - 20) / 10];
+        else
+            part[parts++] = &Twenty_ops[(r - 20) / 10];
+    }
+    if ((r != 0 && (r < 20 || r % 10 != 0)) || n == 0)
+        part[parts++] = ordinal ? &Ordinal_ops[r < 20 ? r : r % 10]
+                                : &Cardinal_ops[r < 20 ? r : r % 10];
+
+    for (len = 0, i = 0; i < parts; i++) {
+        if (op)
+            memcpy(op + len, part[i]->op, part[i]->len);
+        len += part[i]->len;
     }
+    return len;
+}
 
-    if (value >= 1000000000L) //  Billions
-    {
-        say_cardinal(value / 1000000000L);
-        value = value % 1000000000;
-        if (value == 0) {
-            outstring("bIHlIYAXnTH ");
-            return; //  Even billion
-        }
-        outstring("bIHlIYAXn ");
-        if (value < 100) //  as in THREE BILLION AND FIVE
-            outstring("AEnd ");
+/* Say 0..1999.  1100 to 1999 is eleven-hundred to nineteen-hundred, so the
+hundreds come from Cardinals and only the rest from the chunk tables. */
+static void say_chunk(int n, int ordinal)
+{
+    if (n < 1000) {
+        outspan(ordinal ? &Ord_chunk_ops[n] : &Chunk_ops[n]);
+        return;
+    }
+    outspan(&Cardinal_ops[n / 100]);
+    if (n % 100 == 0) {
+        outspan(&Number_word_ops[ordinal ? NW_HUNDREDTH : NW_HUNDRED]);
+        return;
     }
+    outspan(&Number_word_ops[NW_HUNDRED]);
+    outspan(ordinal ? &Ord_chunk_ops[n % 100] : &Chunk_ops[n % 100]);
+}
 
-    if (value >= 1000000L) //  Millions
-    {
-        say_cardinal(value / 1000000L);
-        value = value % 1000000L;
-        if (value == 0) {
-            outstring("mIHlIYAXnTH ");
-            return; //  Even million
+/* Say a number given as groups of three digits, most significant first;
+no more than COUNT(Scales) of them. */
+static void say_groups(int *group, int groups, int ordinal)
+{
+    int i, j, k, rest;
+
+    for (i = 0; i < groups - 2; i++) { //  Millions and up
+        if (group[i] == 0)
+            continue;
+        k = groups - 1 - i;
+        say_chunk(group[i], FALSE);
+        for (j = i + 1; j < groups && group[j] == 0; j++)
+            ;
+        if (j == groups) { //  Even million, billion ...
+            outspan(ordinal ? &Ord_scale_ops[k] : &Scale_ops[k]);
+            return;
         }
-        outstring("mIHlIYAXn ");
-        if (value < 100) //  as in THREE MILLION AND FIVE
-            outstring("AEnd ");
+        outspan(&Scale_ops[k]);
+        if (j == groups - 1 && group[j] < 100) //  as in THREE MILLION AND FIVE
+            outspan(&Number_word_ops[NW_AND]);
     }
 
-    //  Thousands 1000..1099 2000..99999
+    //  Thousands 1000..1099 2000..999999
     //  1100 to 1999 is eleven-hunderd to ninteen-hunderd
-    if ((value >= 1000L && value <= 1099L) || value >= 2000L) {
-        say_cardinal(value / 1000L);
-        value = value % 1000L;
-        if (value == 0) {
-            outstring("THAWzAEndTH ");
-            return; //  Even thousand
+    rest = group[groups - 1];
+    if (groups > 1)
+        rest += 1000 * group[groups - 2];
+    if ((rest >= 1000 && rest <= 1099) || rest >= 2000) {
+        say_chunk(rest / 1000, FALSE);
+        rest %= 1000;
+        if (rest == 0) { //  Even thousand
+            outspan(ordinal ? &Ord_scale_ops[1] : &Scale_ops[1]);
+            return;
         }
-        outstring("THAWzAEnd ");
-        if (value < 100) //  as in THREE THOUSAND AND FIVE
-            outstring("AEnd ");
+        outspan(&Scale_ops[1]);
+        if (rest < 100) //  as in THREE THOUSAND AND FIVE
+            outspan(&Number_word_ops[NW_AND]);
     }
+    say_chunk(rest, ordinal);
+}
+
+//  Read out n digits as one group: "zero four five" for 045.
+static void say_digit_group(char *digit, int n, int ordinal)
+{
+    int value, was = T->stage;
+
+    T->stage = ST_NUMBERS;
+    for (; n > 1 && *digit == '0'; digit++, n--)
+        outspan(&Cardinal_ops[0]);
+    for (value = 0; n--; digit++)
+        value = 10 * value + (*digit - '0');
+    say_chunk(value, ordinal);
+    T->stage = was;
+}
+
+static void number_start(Number *num)
+{
+    num->len = 0;
+    num->streamed = FALSE;
+}
+
+/* Add a digit.  Leading zeros say nothing, as before; a run too long to
+name is read out three digits at a time, keeping the last few back so the
+end can still turn out to be an ordinal. */
+static void number_digit(Number *num, int c)
+{
+    int i;
 
-    if (value >= 100L) {
-        outstring(Cardinals[value / 100]);
-        value = value % 100;
-        if (value == 0) {
-            outstring("hAHndrEHdTH ");
-            return; //  Even hundred
+    if (num->len == 0 && c == '0' && !num->streamed)
+        return;
+    if (num->len == MAX_DIGITS) {
+        for (i = 0; i + 3 < MAX_DIGITS; i += 3) {
+            if (num->streamed || i > 0)
+                outspan(&Number_word_ops[NW_GROUP]);
+            say_digit_group(&num->digit[i], 3, FALSE);
         }
-        outstring("hAHndrEHd ");
+        memmove(num->digit, &num->digit[i], MAX_DIGITS - i);
+        num->len = MAX_DIGITS - i;
+        num->streamed = TRUE;
     }
+    num->digit[num->len++] = (char)c;
+}
+
+static int number_is_one(Number *num)
+{
+    return !num->streamed && num->len == 1 && num->digit[0] == '1';
+}
 
-    if (value >= 20) {
-        if ((value % 10) == 0) {
-            outstring(Ord_twenties[(value - 20) / 10]);
-            return; //  Even ten
+static void say_number(Number *num, int ordinal)
+{
+    int group[COUNT(Scales)], groups, i, n, was = T->stage;
+
+    T->stage = ST_NUMBERS;
+    if (num->streamed) { //  the rest of a long run
+        for (i = 0; i < num->len; i += 3) {
+            n = num->len - i < 3 ? num->len - i : 3;
+            outspan(&Number_word_ops[NW_GROUP]);
+            say_digit_group(&num->digit[i], n, ordinal && i + n == num->len);
         }
-        outstring(Twenties[(value - 20) / 10]);
-        value = value % 10;
+        T->stage = was;
+        return;
     }
 
-    outstring(Ordinals[value]);
-    return;
+    groups = 0;
+    group[0] = 0; //  nothing but zeros
+    for (i = 0; i < num->len;) {
+        n = (num->len - i) % 3 ? (num->len - i) % 3 : 3;
+        for (group[groups] = 0; n--; i++)
+            group[groups] = 10 * group[groups] + (num->digit[i] - '0');
+        groups++;
+    }
+    say_groups(group, groups ? groups : 1, ordinal);
+    T->stage = was;
 }
 
 //  !!!! End of SAYNUM.C
@@ -1292,16 +4334,88 @@ static char *Ascii[] = {
     "dEHl ",
 };
 
+static Span Ascii_ops[COUNT(Ascii)], Pause_op; //  Pause_op is P4
+
+static unsigned char *resolve_table(char **strings, int n, Span *spans,
+                                    unsigned char *op)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        spans[i].op = op;
+        spans[i].len = resolve_phonemes(strings[i], op);
+        op += spans[i].len;
+    }
+    return op;
+}
+
+static size_t table_size(char **strings, int n)
+{
+    size_t size = 0;
+
+    while (n--)
+        size += strlen(*strings++);
+    return size;
+}
+
+//  Turn the number and character name tables into opcodes, once
+void resolve_outputs()
+{
+    static char *pause[] = {"P4 "};
+    unsigned char *op;
+    size_t size;
+    int n;
+
+    if (Fast_speech)
+        pause[0] = "P2 "; //  between spelled letters
+    op = malloc(table_size(Cardinals, COUNT(Cardinals)) +
+                table_size(Twenties, COUNT(Twenties)) +
+                table_size(Ordinals, COUNT(Ordinals)) +
+                table_size(Ord_twenties, COUNT(Ord_twenties)) +
+                table_size(Ascii, COUNT(Ascii)) + table_size(pause, 1) +
+                table_size(Scales, COUNT(Scales)) +
+                table_size(Ord_scales, COUNT(Ord_scales)) +
+                table_size(Number_words, COUNT(Number_words)));
+    if (op == 0) {
+        fputs("Error: Out of memory resolving phonemes.\n", stderr);
+        exit(3);
+    }
+    op = resolve_table(Cardinals, COUNT(Cardinals), Cardinal_ops, op);
+    op = resolve_table(Twenties, COUNT(Twenties), Twenty_ops, op);
+    op = resolve_table(Ordinals, COUNT(Ordinals), Ordinal_ops, op);
+    op = resolve_table(Ord_twenties, COUNT(Ord_twenties), Ord_twenty_ops, op);
+    op = resolve_table(Ascii, COUNT(Ascii), Ascii_ops, op);
+    op = resolve_table(pause, 1, &Pause_op, op);
+    op = resolve_table(Scales, COUNT(Scales), Scale_ops, op);
+    op = resolve_table(Ord_scales, COUNT(Ord_scales), Ord_scale_ops, op);
+    resolve_table(Number_words, COUNT(Number_words), Number_word_ops, op);
+
+    //  Then every chunk of a number, from those
+    for (size = 0, n = 0; n < 1000; n++)
+        size += build_chunk(n, FALSE, 0) + build_chunk(n, TRUE, 0);
+    op = malloc(size);
+    if (op == 0) {
+        fputs("Error: Out of memory resolving phonemes.\n", stderr);
+        exit(3);
+    }
+    for (n = 0; n < 1000; n++) {
+        Chunk_ops[n].op = op;
+        op += Chunk_ops[n].len = build_chunk(n, FALSE, op);
+        Ord_chunk_ops[n].op = op;
+        op += Ord_chunk_ops[n].len = build_chunk(n, TRUE, op);
+    }
+}
+
 void say_ascii(character) int character;
 {
-    outstring(Ascii[character & 0x7F]);
-    outstring("P4 ");
+    outspan(&Ascii_ops[character & 0x7F]);
+    outspan(&Pause_op);
 }
 
 void spell_word(word) char *word;
 {
     for (word++; word[1] != '\0'; word++) {
-        outstring(Ascii[(*word) & 0x7F]);
-        outstring("P4 ");
+        outspan(&Ascii_ops[(*word) & 0x7F]);
+        outspan(&Pause_op);
     }
 }
@@ -0,0 +1,72 @@
+/* libtx2al: English text to SPO256-AL2 allophones, for programs that
+translate in-process rather than run tx2al.  Build tx2al.c with
+T2A_LIBRARY defined to leave main() out (see build-win.bat):
+
+    cc -O2 -c -DT2A_LIBRARY tx2al.c && ar rcs libtx2al.a tx2al.o
+    cc -O2 -shared -fPIC -DT2A_LIBRARY -o libtx2al.so tx2al.c
+
+Settings the command line makes with options are made first, and stay
+for the life of the process: load_lexicon() for -l, start_fast_speech()
+for -s, start_peephole() for -m or -w and use_rule_file() for -u.  Then
+t2a_init() builds the shared tables, once and before any thread that
+translates starts; each of those does so through a context of its own:
+
+    Sink out;
+    t2a_context *t;
+
+    t2a_init();
+    sink_memory(&out, 0, 0);
+    t = t2a_new(&out);
+    t2a_feed(t, text, strlen(text));    (as often as there is text)
+    t2a_finish(t);                      (out.buf[0..out.len) is said)
+    t2a_free(t);
+    sink_close(&out);
+
+A context, and the sink it writes to, is used by one thread at a time.
+Rules from use_rule_file() are loaded again when the file changes, or
+before the next word once t2a_reload() is called; it only sets a flag,
+so a signal handler of the program's may call it.  Errors are reported
+on stderr and exit, as tx2al does. */
+
+#ifndef TX2AL_H
+#define TX2AL_H
+
+#include <stdio.h>
+
+/* Where allophones go, see sink_put(); set one up with sink_file(),
+sink_memory() or sink_callback(). */
+typedef struct _sink {
+    unsigned char *buf;
+    unsigned long len, size; //  bytes in buf, and room for
+    int kind;                //  SINK_
+    int fd;                  //  SINK_FILE
+    void (*fn)(void *, unsigned char *, unsigned long); //  SINK_CALLBACK
+    void *arg;
+    unsigned long lost;      //  SINK_MEMORY output that didn't fit
+    int failed;              //  a write failed
+} Sink;
+
+typedef struct _t2a_context t2a_context; //  see t2a_new()
+
+void sink_file(Sink *, int);
+void sink_memory(Sink *, unsigned char *, unsigned long);
+void sink_callback(Sink *, void (*)(void *, unsigned char *, unsigned long),
+                   void *);
+void sink_put(Sink *, unsigned char *, unsigned long);
+void sink_flush(Sink *);
+void sink_close(Sink *);
+
+void load_lexicon(char *);
+void start_fast_speech(void);
+void start_peephole(char *);
+void use_rule_file(char *);
+
+void t2a_init(void);
+t2a_context *t2a_new(Sink *);
+void t2a_feed(t2a_context *, const char *, unsigned long);
+void t2a_finish(t2a_context *);
+void t2a_file(t2a_context *, FILE *);
+void t2a_free(t2a_context *);
+void t2a_reload(void);
+
+#endif